@@ -26,6 +26,7 @@
 
 #include <algorithm>
 #include <cmath>
+#include <fstream>
 #include <iostream>
 #include <sstream>
 #include <string>
@@ -36,8 +37,12 @@ namespace {
 const char* kTsvReportStr = "Filename of the tab-separated report file";
 const char* kTxtReportStr = "Filename of the text report file";
 const char* kMovesStr = "Moves in UCI format, space separated";
+const char* kPositionsFileStr = "File with positions to analyze, one per line";
+const char* kParallelismStr = "Number of positions to analyze in parallel";
+const char* kNnCacheSizeStr = "NNCache size";
 const char* kMovesToAnalyzeStr = "Number of (last) moves to analyze";
 const char* kNodesStr = "(comma separated) How many nodes to calculate";
+const char* kSingleSearchStr = "Compute all node counts in a single search";
 const char* kTrainExamplesStr =
     "How many examples of training data to generate";
 const char* kWeightsStr = "Network weights file path";
@@ -56,9 +61,14 @@ Analyzer::Analyzer() {
   options_parser_.Add<StringOption>(kTsvReportStr, "tsv-report");
   options_parser_.Add<StringOption>(kTxtReportStr, "txt-report");
   options_parser_.Add<StringOption>(kMovesStr, "moves");
+  options_parser_.Add<StringOption>(kPositionsFileStr, "positions-file");
+  options_parser_.Add<IntOption>(kParallelismStr, 1, 256, "parallelism") = 1;
+  options_parser_.Add<IntOption>(kNnCacheSizeStr, 0, 999999999, "nncache") =
+      200000;
   options_parser_.Add<IntOption>(kMovesToAnalyzeStr, 1, 999, "num-moves") = 4;
   options_parser_.Add<StringOption>(kNodesStr, "nodes-list") =
       "10,50,100,200,400,600,800,1200,1600,5000,10000";
+  options_parser_.Add<BoolOption>(kSingleSearchStr, "single-search") = false;
   options_parser_.Add<IntOption>(kTrainExamplesStr, 1, 999,
                                  "training-examples") = 10;
   options_parser_.Add<StringOption>(kWeightsStr, "weights", 'w') =
@@ -106,10 +116,13 @@ void Analyzer::GatherStats(Table3d* table, const Node* root_node,
   }
 }
 
-void Analyzer::RunOnePosition(const std::vector<Move>& moves) {
-  NNCache cache(200000);
+void Analyzer::RunOnePosition(const AnalyzedPosition& position,
+                              Report* report) {
+  std::vector<Move> moves;
+  for (const auto& move : position.moves) moves.emplace_back(move);
+
   NodeTree tree;
-  tree.ResetToPosition(ChessBoard::kStartingFen, moves);
+  tree.ResetToPosition(position.fen, moves);
 
   auto nodeses = ParseIntList(play_options_->Get<std::string>(kNodesStr));
   std::sort(nodeses.begin(), nodeses.end());
@@ -117,23 +130,52 @@ void Analyzer::RunOnePosition(const std::vector<Move>& moves) {
   Table3d table;
   std::vector<std::string> cols;
 
-  // Run search in increasing number of nodes.
-  for (int nodes : nodeses) {
-    WriteToLog("Nodes: " + std::to_string(nodes));
-    SearchLimits limits;
-    limits.visits = nodes;
+  const auto best_move_callback =
+      std::bind(&Analyzer::OnBestMove, this, std::placeholders::_1, report);
+  const auto info_callback =
+      std::bind(&Analyzer::OnInfo, this, std::placeholders::_1, report);
 
-    Search search(tree, network_.get(),
-                  std::bind(&Analyzer::OnBestMove, this, std::placeholders::_1),
-                  std::bind(&Analyzer::OnInfo, this, std::placeholders::_1),
-                  limits, *play_options_, &cache);
+  if (play_options_->Get<bool>(kSingleSearchStr)) {
+    // Run one search up to the largest number of nodes, and take snapshots of
+    // root stats as smaller numbers of nodes are reached.
+    SearchLimits limits;
+    limits.visits = nodeses.back();
+
+    Search search(tree, network_.get(), best_move_callback, info_callback,
+                  limits, *play_options_, &cache_);
+    search.SetVisitsCallback(
+        {nodeses.begin(), nodeses.end()},
+        [&](int64_t nodes, int64_t visits, Move best_move) {
+          report->log.push_back("Nodes: " + std::to_string(nodes) +
+                                " (visits: " + std::to_string(visits) + ")");
+          auto col = std::to_string(nodes);
+          cols.push_back(col);
+          GatherStats(&table, tree.GetCurrentHead(), col,
+                      tree.IsBlackToMove());
+          table.AddColVal(col, "bestmove", best_move.as_string());
+          // Stats are taken when the whole minibatch is done, which may be
+          // past the requested number of nodes.
+          table.AddColVal(col, "visits", std::to_string(visits));
+        });
 
     search.RunBlocking(1);
-
-    auto col = std::to_string(nodes);
-    cols.push_back(col);
-    GatherStats(&table, tree.GetCurrentHead(), col, tree.IsBlackToMove());
-    table.AddColVal(col, "bestmove", search.GetBestMove().first.as_string());
+  } else {
+    // Run search in increasing number of nodes.
+    for (int nodes : nodeses) {
+      report->log.push_back("Nodes: " + std::to_string(nodes));
+      SearchLimits limits;
+      limits.visits = nodes;
+
+      Search search(tree, network_.get(), best_move_callback, info_callback,
+                    limits, *play_options_, &cache_);
+
+      search.RunBlocking(1);
+
+      auto col = std::to_string(nodes);
+      cols.push_back(col);
+      GatherStats(&table, tree.GetCurrentHead(), col, tree.IsBlackToMove());
+      table.AddColVal(col, "bestmove", search.GetBestMove().first.as_string());
+    }
   }
 
   // Fetch MCTS-agnostic per-move stats P and V.
@@ -152,52 +194,139 @@ void Analyzer::RunOnePosition(const std::vector<Move>& moves) {
     table.AddRowVal(move, "V", std::to_string(node->GetV()));
   }
 
-  // Dump table to log.
+  // Dump table to log. Actual visits are only reported by single search, so
+  // that the default report keeps its columns.
+  std::vector<std::string> col_attrs = {"bestmove"};
+  if (play_options_->Get<bool>(kSingleSearchStr)) {
+    col_attrs.push_back("visits");
+  }
   auto lines = table.RenderTable(cols, rows, {"N", "N%", "U", "Q", "U+Q"},
-                                 {"P", "V"}, {"bestmove"});
-  for (const auto& line : lines) WriteToTsvLog(line);
+                                 {"P", "V"}, col_attrs);
+  for (auto& line : lines) report->tsv.emplace_back(std::move(line));
 }
 
-void Analyzer::Run() {
-  if (!options_parser_.ProcessAllFlags()) return;
+namespace {
+// Parses one line of positions file. Supported formats are:
+// "startpos [moves <moves>]", "fen <fen> [moves <moves>]", or just a list of
+// moves from the starting position.
+void ParsePositionLine(const std::string& line, std::string* fen,
+                       std::vector<std::string>* moves) {
+  auto tokens = StrSplitAtWhitespace(line);
+  *fen = ChessBoard::kStartingFen;
+  moves->clear();
+  if (tokens.empty()) return;
+
+  auto iter = tokens.begin();
+  if (*iter == "startpos") {
+    ++iter;
+  } else if (*iter == "fen") {
+    std::vector<std::string> fen_tokens;
+    for (++iter; iter != tokens.end() && *iter != "moves"; ++iter) {
+      fen_tokens.push_back(*iter);
+    }
+    *fen = StrJoin(fen_tokens);
+  }
+  if (iter != tokens.end() && *iter == "moves") ++iter;
+  moves->assign(iter, tokens.end());
+}
+}  // namespace
 
-  // Open log files.
-  if (!play_options_->Get<std::string>(kTxtReportStr).empty()) {
-    log_.open(play_options_->Get<std::string>(kTxtReportStr).c_str());
+void Analyzer::PopulatePositions() {
+  std::vector<std::pair<std::string, std::vector<std::string>>> lines;
+  const auto& filename = play_options_->Get<std::string>(kPositionsFileStr);
+  if (filename.empty()) {
+    lines.emplace_back(
+        ChessBoard::kStartingFen,
+        StrSplitAtWhitespace(play_options_->Get<std::string>(kMovesStr)));
+  } else {
+    std::ifstream file(filename);
+    if (!file) throw Exception("Cannot read positions from " + filename);
+    std::string line;
+    while (std::getline(file, line)) {
+      // Skip empty lines and comments.
+      const auto first = line.find_first_not_of(" \t\r");
+      if (first == std::string::npos || line[first] == '#') continue;
+      lines.emplace_back();
+      ParsePositionLine(line, &lines.back().first, &lines.back().second);
+    }
   }
-  if (!play_options_->Get<std::string>(kTsvReportStr).empty()) {
-    tsvlog_.open(play_options_->Get<std::string>(kTsvReportStr).c_str());
+
+  // For every line, analyze last several moves.
+  for (auto& line : lines) {
+    auto& moves = line.second;
+    for (int i = 0; i < play_options_->Get<int>(kMovesToAnalyzeStr); ++i) {
+      positions_.push_back({line.first, moves});
+      if (moves.empty()) break;
+      moves.pop_back();
+    }
   }
+}
 
-  // Load network
-  InitializeNetwork();
+void Analyzer::Worker() {
+  while (true) {
+    const AnalyzedPosition* position;
+    {
+      Mutex::Lock lock(positions_mutex_);
+      if (next_position_ >= positions_.size()) break;
+      position = &positions_[next_position_++];
+    }
 
-  // Parse moves.
-  std::vector<std::string> moves_str =
-      StrSplitAtWhitespace(play_options_->Get<std::string>(kMovesStr));
-  std::vector<Move> moves;
-  for (const auto& move : moves_str) moves.emplace_back(move);
-
-  for (int i = 0; i < play_options_->Get<int>(kMovesToAnalyzeStr); ++i) {
-    // Write position to logs.
-    std::string initial_pos;
-    if (moves_str.empty()) {
-      WriteToLog("Position: startpos");
-      WriteToTsvLog({"Startpos."});
+    Report report;
+    // Write position to logs. Positions from the starting position are
+    // written as they always were, so that existing report parsers work.
+    const std::string moves_str = StrJoin(position->moves);
+    if (position->fen != ChessBoard::kStartingFen) {
+      std::string position_str = "fen " + position->fen;
+      if (!moves_str.empty()) position_str += " moves " + moves_str;
+      report.log.push_back("Position: " + position_str);
+      report.tsv.push_back({"Position " + position_str});
+    } else if (moves_str.empty()) {
+      report.log.push_back("Position: startpos");
+      report.tsv.push_back({"Startpos."});
     } else {
-      WriteToLog("Position: moves " + StrJoin(moves_str));
-      WriteToTsvLog({"Moves " + StrJoin(moves_str)});
+      report.log.push_back("Position: moves " + moves_str);
+      report.tsv.push_back({"Moves " + moves_str});
     }
 
     // Run Mcts at different depths.
-    RunOnePosition(moves);
+    RunOnePosition(*position, &report);
+
+    WriteReport(report);
+  }
+}
+
+void Analyzer::Run() {
+  if (!options_parser_.ProcessAllFlags()) return;
 
-    // Run training several times.
+  {
+    // Open log files.
+    Mutex::Lock lock(log_mutex_);
+    if (!play_options_->Get<std::string>(kTxtReportStr).empty()) {
+      log_.open(play_options_->Get<std::string>(kTxtReportStr).c_str());
+    }
+    if (!play_options_->Get<std::string>(kTsvReportStr).empty()) {
+      tsvlog_.open(play_options_->Get<std::string>(kTsvReportStr).c_str());
+    }
+  }
 
-    if (moves.empty()) break;
-    moves.pop_back();
-    moves_str.pop_back();
-    WriteToTsvLog({});
+  // Load network
+  InitializeNetwork();
+  cache_.SetCapacity(play_options_->Get<int>(kNnCacheSizeStr));
+
+  PopulatePositions();
+
+  // Analyze positions in parallel, every thread takes next position when
+  // done with previous one.
+  const int parallelism = std::min<size_t>(
+      play_options_->Get<int>(kParallelismStr), positions_.size());
+  if (parallelism <= 1) {
+    Worker();
+  } else {
+    std::vector<std::thread> threads;
+    for (int i = 0; i < parallelism; ++i) {
+      threads.emplace_back([this]() { Worker(); });
+    }
+    for (auto& thread : threads) thread.join();
   }
 
   // DumpFlags();
@@ -221,6 +350,14 @@ void Analyzer::InitializeNetwork() {
   network_ = NetworkFactory::Get()->Create(backend, weights, network_options);
 }
 
+void Analyzer::WriteReport(const Report& report) {
+  Mutex::Lock lock(log_mutex_);
+  for (const auto& line : report.log) WriteToLog(line);
+  // Positions are separated by an empty line.
+  if (reports_written_++ > 0) WriteToTsvLog({});
+  for (const auto& line : report.tsv) WriteToTsvLog(line);
+}
+
 void Analyzer::WriteToLog(const std::string& line) const {
   std::cout << line << std::endl;
   if (log_) log_ << line << std::endl;
@@ -240,11 +377,11 @@ void Analyzer::WriteToTsvLog(const std::vector<std::string>& line) const {
   tsvlog_ << std::endl;
 }
 
-void Analyzer::OnBestMove(const BestMoveInfo& move) const {
-  WriteToLog("BestMove: " + move.bestmove.as_string());
+void Analyzer::OnBestMove(const BestMoveInfo& move, Report* report) const {
+  report->log.push_back("BestMove: " + move.bestmove.as_string());
 }
 
-void Analyzer::OnInfo(const ThinkingInfo& info) const {
+void Analyzer::OnInfo(const ThinkingInfo& info, Report* report) const {
   std::string res = "Info";
   if (info.depth >= 0) res += " depth " + std::to_string(info.depth);
   if (info.seldepth >= 0) res += " seldepth " + std::to_string(info.seldepth);
@@ -258,7 +395,7 @@ void Analyzer::OnInfo(const ThinkingInfo& info) const {
     for (const auto& move : info.pv) res += " " + move.as_string();
   }
   if (!info.comment.empty()) res += " string " + info.comment;
-  WriteToLog(res);
+  report->log.push_back(res);
 }
 
 }  // namespace lczero
\ No newline at end of file
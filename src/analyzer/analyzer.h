@@ -19,11 +19,14 @@
 #pragma once
 
 #include <fstream>
+#include <thread>
 #include "analyzer/table.h"
 #include "chess/board.h"
 #include "chess/callbacks.h"
 #include "mcts/node.h"
+#include "neural/cache.h"
 #include "neural/network.h"
+#include "utils/mutex.h"
 #include "utils/optionsparser.h"
 
 namespace lczero {
@@ -34,23 +37,51 @@ class Analyzer {
   void Run();
 
  private:
-  void RunOnePosition(const std::vector<Move>& position);
+  // Starting position and moves (in UCI format) played from it.
+  struct AnalyzedPosition {
+    std::string fen;
+    std::vector<std::string> moves;
+  };
 
-  void WriteToLog(const std::string& line) const;
-  void WriteToTsvLog(const std::vector<std::string>& line) const;
+  // Output of a single position. Positions are analyzed in parallel, so their
+  // output is collected and then written to logs at once.
+  struct Report {
+    std::vector<std::string> log;
+    std::vector<std::vector<std::string>> tsv;
+  };
+
+  // Fills positions_ either from file or from command line.
+  void PopulatePositions();
+  // Can run several copies of it in separate threads.
+  void Worker();
+  void RunOnePosition(const AnalyzedPosition& position, Report* report);
+
+  void WriteReport(const Report& report);
+  void WriteToLog(const std::string& line) const REQUIRES(log_mutex_);
+  void WriteToTsvLog(const std::vector<std::string>& line) const
+      REQUIRES(log_mutex_);
 
   void InitializeNetwork();
-  void OnBestMove(const BestMoveInfo& move) const;
-  void OnInfo(const ThinkingInfo& info) const;
+  void OnBestMove(const BestMoveInfo& move, Report* report) const;
+  void OnInfo(const ThinkingInfo& info, Report* report) const;
   void GatherStats(Table3d* table, const Node* root_node, std::string& col,
                    bool flip);
 
   std::unique_ptr<Network> network_;
+  // Cache is shared between all positions.
+  NNCache cache_;
   OptionsParser options_parser_;
   const OptionsDict* play_options_;
   // const OptionsDict* training_options_;
-  mutable std::ofstream log_;
-  mutable std::ofstream tsvlog_;
+
+  std::vector<AnalyzedPosition> positions_;
+  Mutex positions_mutex_;
+  size_t next_position_ GUARDED_BY(positions_mutex_) = 0;
+
+  Mutex log_mutex_;
+  mutable std::ofstream log_ GUARDED_BY(log_mutex_);
+  mutable std::ofstream tsvlog_ GUARDED_BY(log_mutex_);
+  int reports_written_ GUARDED_BY(log_mutex_) = 0;
 };
 
 }  // namespace lczero
@@ -0,0 +1,138 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2018 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "benchmark/benchmark.h"
+
+#include <chrono>
+#include <iostream>
+#include "mcts/search.h"
+#include "neural/cache.h"
+#include "neural/factory.h"
+#include "neural/loader.h"
+#include "utils/largepages.h"
+#include "utils/numa.h"
+
+namespace lczero {
+namespace {
+const char* kThreadsStr = "Number of worker threads";
+const char* kNnCacheSizeStr = "NNCache size";
+const char* kNodesStr = "Number of nodes to search per position";
+const char* kFenStr = "Position to search, in FEN (empty for built-in set)";
+const char* kWeightsStr = "Network weights file path";
+const char* kNnBackendStr = "NN backend to use";
+const char* kNnBackendOptionsStr = "NN backend parameters";
+
+const char* kAutoDiscover = "<autodiscover>";
+
+// Opening, middlegame and endgame positions, so that trees of different
+// width are measured.
+const std::vector<std::string> kPositions = {
+    "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+    "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+    "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+    "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+};
+}  // namespace
+
+Benchmark::Benchmark() {
+  options_parser_.Add<StringOption>(kWeightsStr, "weights", 'w') =
+      kAutoDiscover;
+  options_parser_.Add<IntOption>(kThreadsStr, 1, 128, "threads", 't') = 2;
+  options_parser_.Add<IntOption>(kNnCacheSizeStr, 0, 999999999, "nncache") =
+      200000;
+  options_parser_.Add<IntOption>(kNodesStr, 1, 999999999, "nodes") = 10000;
+  options_parser_.Add<StringOption>(kFenStr, "fen");
+
+  const auto backends = NetworkFactory::Get()->GetBackendsList();
+  options_parser_.Add<ChoiceOption>(kNnBackendStr, backends, "backend") =
+      backends.empty() ? "<none>" : backends[0];
+  options_parser_.Add<StringOption>(kNnBackendOptionsStr, "backend-opts");
+
+  Search::PopulateUciParams(&options_parser_);
+  PopulateLargePagesOptions(&options_parser_);
+  PopulateNumaOptions(&options_parser_);
+
+  // Searches should do the same amount of work in every run.
+  auto defaults = options_parser_.GetMutableDefaultsOptions();
+  defaults->Set<bool>(Search::kSmartPruningStr, false);
+}
+
+void Benchmark::InitializeNetwork() {
+  std::string net_path = options_->Get<std::string>(kWeightsStr);
+  if (net_path == kAutoDiscover) net_path = DiscoveryWeightsFile();
+  Weights weights = LoadWeightsFromFile(net_path);
+
+  OptionsDict network_options = OptionsDict::FromString(
+      options_->Get<std::string>(kNnBackendOptionsStr),
+      &options_parser_.GetOptionsDict());
+
+  network_ = NetworkFactory::Get()->Create(
+      options_->Get<std::string>(kNnBackendStr), weights, network_options);
+}
+
+void Benchmark::Run() {
+  if (!options_parser_.ProcessAllFlags()) return;
+  options_ = &options_parser_.GetOptionsDict();
+  ConfigureLargePages(*options_);
+  ConfigureNuma(*options_);
+  InitializeNetwork();
+
+  std::vector<std::string> positions = kPositions;
+  if (!options_->Get<std::string>(kFenStr).empty()) {
+    positions = {options_->Get<std::string>(kFenStr)};
+  }
+  const int threads = options_->Get<int>(kThreadsStr);
+  SearchLimits limits;
+  limits.visits = options_->Get<int>(kNodesStr);
+
+  std::cout << "Node size: " << sizeof(Node) << " bytes" << std::endl;
+  int64_t total_nodes = 0;
+  int64_t total_ms = 0;
+  for (size_t i = 0; i < positions.size(); ++i) {
+    // Every position starts with empty cache and tree.
+    NNCache cache(options_->Get<int>(kNnCacheSizeStr));
+    NodeTree tree;
+    tree.ResetToPosition(positions[i], {});
+
+    Move best_move;
+    int64_t nodes = 0;
+    Search search(tree, network_.get(),
+                  [&](const BestMoveInfo& info) { best_move = info.bestmove; },
+                  [&](const ThinkingInfo& info) {
+                    if (info.nodes > 0) nodes = info.nodes;
+                  },
+                  limits, *options_, &cache);
+    const auto start = std::chrono::steady_clock::now();
+    search.RunBlocking(threads);
+    const int64_t ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                           std::chrono::steady_clock::now() - start)
+                           .count();
+
+    std::cout << "Position " << i + 1 << "/" << positions.size()
+              << ": bestmove " << best_move.as_string() << " nodes " << nodes
+              << " time " << ms << " nps "
+              << (ms ? nodes * 1000 / ms : 0) << std::endl;
+    total_nodes += nodes;
+    total_ms += ms;
+  }
+  std::cout << "Total: nodes " << total_nodes << " time " << total_ms
+            << " nps " << (total_ms ? total_nodes * 1000 / total_ms : 0)
+            << std::endl;
+}
+
+}  // namespace lczero
@@ -0,0 +1,44 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2018 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "neural/network.h"
+#include "utils/optionsparser.h"
+
+namespace lczero {
+
+// Searches a fixed set of positions to a fixed number of nodes and reports
+// search speed, so that builds and settings can be compared on equal work.
+class Benchmark {
+ public:
+  Benchmark();
+  void Run();
+
+ private:
+  void InitializeNetwork();
+
+  std::unique_ptr<Network> network_;
+  OptionsParser options_parser_;
+  const OptionsDict* options_;
+};
+
+}  // namespace lczero
@@ -309,4 +309,6 @@ uint16_t Move::as_packed_int() const {
 
 uint16_t Move::as_nn_index() const { return kMoveToIdx[as_packed_int()]; }
 
+Move Move::FromNNIndex(uint16_t index) { return kIdxToMove[index]; }
+
 }  // namespace lczero
\ No newline at end of file
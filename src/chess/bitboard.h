@@ -207,6 +207,9 @@ class Move {
 
   // 0 .. 1857, to use in neural networks.
   uint16_t as_nn_index() const;
+  // Inverse of as_nn_index(). Knight promotions come back without promotion,
+  // as they share index with moves of other pieces to the last rank.
+  static Move FromNNIndex(uint16_t index);
 
   bool operator==(const Move& other) const {
     return from_ == other.from_ && to_ == other.to_ &&
@@ -23,6 +23,8 @@
 #include "mcts/search.h"
 #include "neural/factory.h"
 #include "neural/loader.h"
+#include "utils/largepages.h"
+#include "utils/numa.h"
 
 namespace lczero {
 namespace {
@@ -38,6 +40,7 @@ const char* kNnBackendStr = "NN backend to use";
 const char* kNnBackendOptionsStr = "NN backend parameters";
 const char* kSlowMoverStr = "Scale thinking time";
 const char* kMoveOverheadStr = "Move time overhead in milliseconds";
+const char* kMaxFreeTreeMemoryStr = "Free tree memory to keep in MB";
 
 const char* kAutoDiscover = "<autodiscover>";
 }  // namespace
@@ -47,7 +50,8 @@ EngineController::EngineController(BestMoveInfo::Callback best_move_callback,
                                    const OptionsDict& options)
     : options_(options),
       best_move_callback_(best_move_callback),
-      info_callback_(info_callback) {}
+      info_callback_(info_callback),
+      cache_metrics_(RegisterCacheMetrics(&cache_)) {}
 
 void EngineController::PopulateOptions(OptionsParser* options) {
   using namespace std::placeholders;
@@ -65,6 +69,11 @@ void EngineController::PopulateOptions(OptionsParser* options) {
   options->Add<StringOption>(kNnBackendOptionsStr, "backend-opts");
   options->Add<FloatOption>(kSlowMoverStr, 0.0, 100.0, "slowmover") = 2.2;
   options->Add<IntOption>(kMoveOverheadStr, 0, 10000, "move-overhead") = 100;
+  options->Add<IntOption>(
+      kMaxFreeTreeMemoryStr, 0, 999999, "max-free-tree-mb", '\0',
+      [](int mb) {
+        NodeTree::SetNodePoolTrimThreshold(static_cast<size_t>(mb) << 20);
+      }) = 0;
 
   Search::PopulateUciParams(options);
 }
@@ -139,6 +148,7 @@ void EngineController::NewGame() {
   cache_.Clear();
   search_.reset();
   tree_.reset();
+  NodeTree::TrimNodePool();
   UpdateNetwork();
 }
 
@@ -185,10 +195,16 @@ EngineLoop::EngineLoop()
   options_.Add<StringOption>(
       kDebugLogStr, "debuglog", 'l',
       [this](const std::string& filename) { SetLogFilename(filename); }) = "";
+  MetricsExporter::PopulateOptions(&options_);
+  PopulateLargePagesOptions(&options_);
+  PopulateNumaOptions(&options_);
 }
 
 void EngineLoop::RunLoop() {
   if (!options_.ProcessAllFlags()) return;
+  ConfigureLargePages(options_.GetOptionsDict());
+  ConfigureNuma(options_.GetOptionsDict());
+  metrics_exporter_ = MetricsExporter::Create(options_.GetOptionsDict());
   UciLoop::RunLoop();
 }
 
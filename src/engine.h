@@ -22,6 +22,7 @@
 #include "mcts/search.h"
 #include "neural/cache.h"
 #include "neural/network.h"
+#include "utils/metrics.h"
 #include "utils/mutex.h"
 #include "utils/optionsparser.h"
 
@@ -73,6 +74,7 @@ class EngineController {
   ThinkingInfo::Callback info_callback_;
 
   NNCache cache_;
+  std::vector<Metrics::Registration> cache_metrics_;
   std::unique_ptr<Network> network_;
 
   // Locked means that there is some work to wait before responding readyok.
@@ -110,6 +112,7 @@ class EngineLoop : public UciLoop {
   OptionsParser options_;
   bool options_sent_ = false;
   EngineController engine_;
+  std::unique_ptr<MetricsExporter> metrics_exporter_;
 };
 
 }  // namespace lczero
\ No newline at end of file
@@ -18,6 +18,7 @@
 
 #include <iostream>
 #include "analyzer/analyzer.h"
+#include "benchmark/benchmark.h"
 #include "engine.h"
 #include "selfplay/loop.h"
 #include "utils/commandline.h"
@@ -31,6 +32,7 @@ int main(int argc, const char** argv) {
   CommandLine::RegisterMode("uci", "(default) Act as UCI engine");
   CommandLine::RegisterMode("selfplay", "Play games with itself");
   CommandLine::RegisterMode("debug", "Generate debug data for a position");
+  CommandLine::RegisterMode("benchmark", "Measure search speed");
 
   if (CommandLine::ConsumeCommand("selfplay")) {
     // Selfplay mode.
@@ -40,6 +42,10 @@ int main(int argc, const char** argv) {
     // Runs analyzer mode.
     Analyzer analyzer;
     analyzer.Run();
+  } else if (CommandLine::ConsumeCommand("benchmark")) {
+    // Benchmark mode.
+    Benchmark benchmark;
+    benchmark.Run();
   } else {
     // Consuming optional "uci" mode.
     CommandLine::ConsumeCommand("uci");
@@ -0,0 +1,123 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2018 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "mcts/evalqueue.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace lczero {
+
+EvalQueue::EvalQueue(Network* network, NNCache* cache, int max_batch,
+                     int max_concurrent_batches)
+    : network_(network), cache_(cache), max_batch_(max_batch) {
+  for (int i = 0; i < max_concurrent_batches; ++i) {
+    threads_.emplace_back([this]() { Worker(); });
+  }
+}
+
+EvalQueue::~EvalQueue() {
+  {
+    Mutex::Lock lock(mutex_);
+    assert(in_flight_ == 0);
+    stop_ = true;
+  }
+  request_cv_.notify_all();
+  for (auto& thread : threads_) thread.join();
+}
+
+void EvalQueue::Submit(Node* node, uint64_t hash, InputPlanes&& planes,
+                       std::vector<uint16_t>&& moves) {
+  {
+    Mutex::Lock lock(mutex_);
+    requests_.push_back({node, hash, std::move(planes), std::move(moves)});
+    ++in_flight_;
+  }
+  request_cv_.notify_one();
+}
+
+void EvalQueue::TakeEvaluated(std::vector<Evaluation>* evaluations,
+                              bool wait) {
+  std::unique_lock<std::mutex> lock(mutex_.get_raw());
+  if (wait) {
+    evaluated_cv_.wait(lock,
+                       [this]() { return !evaluated_.empty() || !in_flight_; });
+  }
+  in_flight_ -= evaluated_.size();
+  for (auto& evaluation : evaluated_) {
+    evaluations->push_back(std::move(evaluation));
+  }
+  evaluated_.clear();
+}
+
+int EvalQueue::GetInFlight() const {
+  Mutex::Lock lock(mutex_);
+  return in_flight_;
+}
+
+void EvalQueue::Worker() {
+  std::vector<Request> batch;
+  std::vector<Evaluation> results;
+  while (true) {
+    batch.clear();
+    {
+      std::unique_lock<std::mutex> lock(mutex_.get_raw());
+      request_cv_.wait(lock, [this]() {
+        return stop_ ||
+               (!requests_.empty() &&
+                (computing_ == 0 ||
+                 requests_.size() >= static_cast<size_t>(max_batch_)));
+      });
+      if (stop_) break;
+      // Take everything which was queued while previous batch was computed.
+      const size_t count = std::min<size_t>(requests_.size(), max_batch_);
+      ++computing_;
+      std::move(requests_.begin(), requests_.begin() + count,
+                std::back_inserter(batch));
+      requests_.erase(requests_.begin(), requests_.begin() + count);
+    }
+
+    CachingComputation computation(network_->NewComputation(), cache_);
+    for (auto& request : batch) {
+      // Moves are still needed to extract priors.
+      auto moves = request.moves;
+      computation.AddInput(request.hash, std::move(request.planes),
+                           std::move(moves));
+    }
+    computation.ComputeBlocking();
+
+    results.clear();
+    for (size_t i = 0; i < batch.size(); ++i) {
+      results.push_back({batch[i].node, 0.0f, {}});
+      auto& result = results.back();
+      result.p.resize(batch[i].moves.size());
+      result.q = computation.GetQAndPVals(i, batch[i].moves, result.p.data());
+    }
+
+    {
+      Mutex::Lock lock(mutex_);
+      for (auto& result : results) evaluated_.push_back(std::move(result));
+      --computing_;
+    }
+    evaluated_cv_.notify_all();
+    // Partial batch may be started now.
+    request_cv_.notify_one();
+  }
+}
+
+}  // namespace lczero
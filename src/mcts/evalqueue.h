@@ -0,0 +1,95 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2018 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <condition_variable>
+#include <thread>
+#include <vector>
+#include "mcts/node.h"
+#include "neural/cache.h"
+#include "neural/network.h"
+#include "utils/mutex.h"
+
+namespace lczero {
+
+// Evaluates leaves submitted one at a time from any number of search threads.
+// A dedicated thread takes everything queued (up to a batch size limit) while
+// the previous batch was computing, so batch size doesn't depend on how many
+// threads submit. Results are stored in the NN cache, and evaluated leaves
+// are handed back in order of completion, not in order of submission.
+//
+// Several batches may be computed at once, e.g. by a multiplexing backend
+// with many GPUs. While some batch is computing, the others are only started
+// when full, so that concurrency doesn't fragment batches.
+class EvalQueue {
+ public:
+  struct Evaluation {
+    Node* node;
+    // Q value of the position, from the point of view of the side to move.
+    float q;
+    // Priors of moves, in order they were submitted.
+    std::vector<float> p;
+  };
+
+  EvalQueue(Network* network, NNCache* cache, int max_batch,
+            int max_concurrent_batches);
+  // All submitted leaves have to be taken before destruction.
+  ~EvalQueue();
+
+  // Queues @node for evaluation. @moves are NN indices of moves to return
+  // priors for, also stored in cache.
+  void Submit(Node* node, uint64_t hash, InputPlanes&& planes,
+              std::vector<uint16_t>&& moves);
+
+  // Appends evaluated leaves to @evaluations. If @wait and none are ready,
+  // blocks until some are, unless nothing is in flight.
+  void TakeEvaluated(std::vector<Evaluation>* evaluations, bool wait);
+
+  // Number of leaves submitted but not taken yet.
+  int GetInFlight() const;
+
+ private:
+  struct Request {
+    Node* node;
+    uint64_t hash;
+    InputPlanes planes;
+    std::vector<uint16_t> moves;
+  };
+
+  void Worker();
+
+  Network* const network_;
+  NNCache* const cache_;
+  const int max_batch_;
+
+  mutable Mutex mutex_;
+  std::condition_variable request_cv_;
+  std::condition_variable evaluated_cv_;
+  std::vector<Request> requests_ GUARDED_BY(mutex_);
+  std::vector<Evaluation> evaluated_ GUARDED_BY(mutex_);
+  int in_flight_ GUARDED_BY(mutex_) = 0;
+  bool stop_ GUARDED_BY(mutex_) = false;
+
+  // Number of batches being computed.
+  int computing_ GUARDED_BY(mutex_) = 0;
+
+  std::vector<std::thread> threads_;
+};
+
+}  // namespace lczero
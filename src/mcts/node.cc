@@ -17,15 +17,23 @@
 */
 
 #include "mcts/node.h"
+#include "mcts/node_pool.h"
 
 #include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <cstring>
 #include <iostream>
+#include <iterator>
+#include <limits>
 #include <sstream>
+#include <tuple>
 #include "neural/encoder.h"
 #include "neural/network.h"
 #include "utils/hashcat.h"
+#include "utils/largepages.h"
+#include "utils/metrics.h"
+#include "utils/numa.h"
 
 namespace lczero {
 
@@ -35,62 +43,70 @@ namespace lczero {
 
 namespace {
 const int kAllocationSize = 1024 * 64;
+const size_t kCacheLineSize = 64;
 }  // namespace
 
-class Node::Pool {
- public:
-  // Allocates a new node and initializes it with all zeros.
-  Node* AllocateNode();
-  // Return node to the pool.
-  void ReleaseNode(Node*);
-
-  // Releases all children of the node, except specified. Also updates pointers
-  // accordingly.
-  void ReleaseAllChildrenExceptOne(Node* root, Node* subtree);
-  // Releases all children, but doesn't release the node isself.
-  void ReleaseChildren(Node*);
-  // Releases all children and the node itself;
-  void ReleaseSubtree(Node*);
-
- private:
-  void AllocateNewBatch();
-  void ReleaseNodeInternal(Node*);
-  void ReleaseChildrenInternal(Node*);
-  void ReleaseSubtreeInternal(Node*);
-
-  union FreeNode {
-    FreeNode* next;
-    Node node;
-
-    FreeNode() {}
-  };
-
-  mutable Mutex mutex_;
-  // Linked list of free nodes.
-  FreeNode* free_list_ GUARDED_BY(mutex_) = nullptr;
-
-  // Mutex for slow but rare operations.
-  mutable Mutex allocations_mutex_ ACQUIRED_AFTER(mutex_);
-  FreeNode* reserve_list_ GUARDED_BY(allocations_mutex_) = nullptr;
-  std::vector<std::unique_ptr<FreeNode[]>> allocations_
-      GUARDED_BY(allocations_mutex_);
-};
+// Every node occupies exactly one cache line of the pool, so that selection
+// touches one line per child, and threads updating N-in-flight of different
+// nodes never write to the same line.
+static_assert(sizeof(Node) == kCacheLineSize, "Node must fill a cache line");
+
+Node::Pool::Pool() : Pool(GetMaxNumaNodes()) {}
+
+Node::Pool::Pool(int max_arenas)
+    : max_arenas_(max_arenas),
+      free_lists_(max_arenas_),
+      reserve_lists_(max_arenas_) {
+  auto* metrics = Metrics::Get();
+  metrics_.push_back(metrics->AddGauge(
+      "lc0_node_pool_used_nodes", "Number of tree nodes in use.", [this]() {
+        Mutex::Lock lock(mutex_);
+        return nodes_in_use_;
+      }));
+  metrics_.push_back(metrics->AddGauge(
+      "lc0_node_pool_allocated_nodes",
+      "Number of tree nodes allocated from the system.", [this]() {
+        Mutex::Lock lock(allocations_mutex_);
+        return batches_.size() * kAllocationSize;
+      }));
+  metrics_.push_back(metrics->AddGauge(
+      "lc0_node_pool_allocated_bytes",
+      "Memory allocated for tree nodes, in bytes.", [this]() {
+        Mutex::Lock lock(allocations_mutex_);
+        size_t bytes = 0;
+        for (const auto& batch : batches_) bytes += batch.memory.size();
+        return bytes;
+      }));
+  metrics_.push_back(metrics->AddCounter(
+      "lc0_node_pool_trimmed_bytes_total",
+      "Memory of tree nodes returned to the system.", [this]() {
+        Mutex::Lock lock(mutex_);
+        return trimmed_bytes_;
+      }));
+}
 
 Node* Node::Pool::AllocateNode() {
+  const int num_arenas = std::min(GetNumaNodeCount(), max_arenas_);
+  return AllocateNode(std::min(GetThreadNumaNode(), num_arenas - 1));
+}
+
+Node* Node::Pool::AllocateNode(int arena) {
   while (true) {
     Node* result = nullptr;
     {
       Mutex::Lock lock(mutex_);
+      auto& free_list = free_lists_[arena];
       // Try to pick from a head of the freelist.
-      if (free_list_) {
-        result = &free_list_->node;
-        free_list_ = free_list_->next;
+      if (free_list) {
+        result = &free_list->node;
+        free_list = free_list->next;
+        ++nodes_in_use_;
       } else {
         // Free list empty. Trying to make reserve list free list.
         Mutex::Lock lock(allocations_mutex_);
-        if (reserve_list_) {
-          free_list_ = reserve_list_;
-          reserve_list_ = nullptr;
+        if (reserve_lists_[arena]) {
+          free_list = reserve_lists_[arena];
+          reserve_lists_[arena] = nullptr;
         }
       }
     }
@@ -105,40 +121,79 @@ Node* Node::Pool::AllocateNode() {
       Mutex::Lock lock(allocations_mutex_);
       // Reserve is empty now, so unless another thread did that, we have to
       // rebuild a new reserve.
-      if (!reserve_list_) AllocateNewBatch();
+      if (!reserve_lists_[arena]) AllocateNewBatch(arena);
     }
     // Repeat again, now as we have reserve list and (possibly) free list.
   }
 }
 
-void Node::Pool::ReleaseNode(Node* node) {
+void Node::Pool::ReleaseWithLocks(Node* node,
+                                  void (Pool::*release)(Node*, bool)) {
   Mutex::Lock lock(mutex_);
-  ReleaseNodeInternal(node);
+  // Nodes of other arenas are only given out after multiple_arenas_ is set,
+  // so if it's not, all nodes being released are from the first arena.
+  if (multiple_arenas_) {
+    Mutex::Lock allocations_lock(allocations_mutex_);
+    (this->*release)(node, true);
+  } else {
+    (this->*release)(node, false);
+  }
+}
+
+void Node::Pool::ReleaseNode(Node* node) {
+  ReleaseWithLocks(node, &Pool::ReleaseNodeInternal);
 }
 
-void Node::Pool::ReleaseNodeInternal(Node* node) REQUIRES(mutex_) {
+// Thread safety analysis can't tell that allocations_mutex_ is held whenever
+// @by_batch is set.
+void Node::Pool::ReleaseNodeInternal(Node* node, bool by_batch)
+    REQUIRES(mutex_) NO_THREAD_SAFETY_ANALYSIS {
   auto* free_node = reinterpret_cast<FreeNode*>(node);
-  free_node->next = free_list_;
-  free_list_ = free_node;
+  auto& free_list =
+      free_lists_[by_batch ? batches_[BatchOf(free_node)].arena : 0];
+  free_node->next = free_list;
+  free_list = free_node;
+  --nodes_in_use_;
 }
 
-void Node::Pool::AllocateNewBatch() REQUIRES(allocations_mutex_) {
-  allocations_.emplace_back(std::make_unique<FreeNode[]>(kAllocationSize));
+size_t Node::Pool::BatchOf(const FreeNode* node) const
+    REQUIRES(allocations_mutex_) {
+  auto iter = std::upper_bound(
+      batches_.begin(), batches_.end(), node,
+      [](const FreeNode* node, const Batch& batch) {
+        return node < static_cast<const FreeNode*>(batch.memory.get());
+      });
+  return std::prev(iter) - batches_.begin();
+}
 
-  FreeNode* new_nodes = allocations_.back().get();
+void Node::Pool::AllocateNewBatch(int arena) REQUIRES(allocations_mutex_) {
+  PageAllocation memory(kAllocationSize * sizeof(FreeNode));
+  // Pin pages before they are touched below.
+  if (GetNumaNodeCount() > 1) {
+    BindMemoryToNumaNode(memory.get(), memory.size(), arena);
+  }
+  FreeNode* new_nodes = static_cast<FreeNode*>(memory.get());
   for (int i = 0; i < kAllocationSize; ++i) {
     FreeNode* n = new_nodes + i;
-    n->next = reserve_list_;
-    reserve_list_ = n;
+    n->next = reserve_lists_[arena];
+    reserve_lists_[arena] = n;
   }
+  auto position = std::upper_bound(
+      batches_.begin(), batches_.end(), new_nodes,
+      [](const FreeNode* node, const Batch& batch) {
+        return node < static_cast<const FreeNode*>(batch.memory.get());
+      });
+  batches_.insert(position, Batch{std::move(memory), arena});
+  ++num_batches_;
+  if (arena != 0) multiple_arenas_ = true;
 }
 
 void Node::Pool::ReleaseChildren(Node* node) {
-  Mutex::Lock lock(mutex_);
-  ReleaseChildrenInternal(node);
+  ReleaseWithLocks(node, &Pool::ReleaseChildrenInternal);
 }
 
-void Node::Pool::ReleaseChildrenInternal(Node* node) REQUIRES(mutex_) {
+void Node::Pool::ReleaseChildrenInternal(Node* node, bool by_batch)
+    REQUIRES(mutex_) {
   Node* next = node->child_;
   // Iterating manually rather than with iterator, as node is released in the
   // middle and can be taken by other threads, so we have to be careful.
@@ -147,9 +202,12 @@ void Node::Pool::ReleaseChildrenInternal(Node* node) REQUIRES(mutex_) {
     // Getting next after releasing node, as otherwise it can be reallocated
     // and overwritten.
     next = next->sibling_;
-    ReleaseSubtreeInternal(iter);
+    ReleaseSubtreeInternal(iter, by_batch);
   }
   node->child_ = nullptr;
+  node->num_children_ = 0;
+  node->visited_policy_ = 0.0f;
+  node->best_child_ = nullptr;
 }
 
 void Node::Pool::ReleaseAllChildrenExceptOne(Node* root, Node* subtree) {
@@ -167,19 +225,97 @@ void Node::Pool::ReleaseAllChildrenExceptOne(Node* root, Node* subtree) {
     }
   }
   root->child_ = child;
+  root->num_children_ = 0;
+  root->visited_policy_ = 0.0f;
+  root->best_child_ = nullptr;
   if (child) {
     child->sibling_ = nullptr;
+    root->num_children_ = 1;
+    if (child->GetNStarted() > 0) root->visited_policy_ = child->GetP();
+    if (child->GetN() > 0) root->best_child_ = child;
   }
 }
 
 void Node::Pool::ReleaseSubtree(Node* node) {
+  ReleaseWithLocks(node, &Pool::ReleaseSubtreeInternal);
+}
+
+void Node::Pool::ReleaseSubtreeInternal(Node* node, bool by_batch)
+    REQUIRES(mutex_) {
+  ReleaseChildrenInternal(node, by_batch);
+  ReleaseNodeInternal(node, by_batch);
+}
+
+void Node::Pool::Trim() {
   Mutex::Lock lock(mutex_);
-  ReleaseSubtreeInternal(node);
+  Mutex::Lock allocations_lock(allocations_mutex_);
+
+  // Usual case between games, no need to look at free nodes.
+  if (nodes_in_use_ == 0) {
+    for (const auto& batch : batches_) trimmed_bytes_ += batch.memory.size();
+    batches_.clear();
+    num_batches_ = 0;
+    std::fill(free_lists_.begin(), free_lists_.end(), nullptr);
+    std::fill(reserve_lists_.begin(), reserve_lists_.end(), nullptr);
+    free_nodes_after_trim_ = 0;
+    return;
+  }
+
+  // Count free nodes of every batch.
+  std::vector<int> free_nodes(batches_.size());
+  for (const auto* lists : {&free_lists_, &reserve_lists_}) {
+    for (const FreeNode* list : *lists) {
+      for (const FreeNode* node = list; node; node = node->next) {
+        ++free_nodes[BatchOf(node)];
+      }
+    }
+  }
+  std::vector<bool> release(batches_.size());
+  bool release_any = false;
+  for (size_t i = 0; i < batches_.size(); ++i) {
+    release[i] = free_nodes[i] == kAllocationSize;
+    release_any |= release[i];
+  }
+
+  if (release_any) {
+    // Unlink nodes of released batches, keeping order of the rest.
+    for (auto* lists : {&free_lists_, &reserve_lists_}) {
+      for (FreeNode*& list : *lists) {
+        FreeNode** tail = &list;
+        for (FreeNode* node = list; node; node = node->next) {
+          if (!release[BatchOf(node)]) {
+            *tail = node;
+            tail = &node->next;
+          }
+        }
+        *tail = nullptr;
+      }
+    }
+    size_t kept = 0;
+    for (size_t i = 0; i < batches_.size(); ++i) {
+      if (release[i]) {
+        trimmed_bytes_ += batches_[i].memory.size();
+      } else {
+        batches_[kept++] = std::move(batches_[i]);
+      }
+    }
+    // Destroying moved out allocations unmaps them.
+    batches_.erase(batches_.begin() + kept, batches_.end());
+    num_batches_ = kept;
+  }
+  free_nodes_after_trim_ = batches_.size() * kAllocationSize - nodes_in_use_;
 }
 
-void Node::Pool::ReleaseSubtreeInternal(Node* node) REQUIRES(mutex_) {
-  ReleaseChildrenInternal(node);
-  ReleaseNodeInternal(node);
+void Node::Pool::MaybeTrim() {
+  const size_t threshold = trim_threshold_;
+  if (threshold == 0) return;
+  int64_t free_nodes;
+  {
+    Mutex::Lock lock(mutex_);
+    free_nodes = num_batches_ * kAllocationSize - nodes_in_use_;
+    if (free_nodes <= 2 * free_nodes_after_trim_) return;
+  }
+  if (free_nodes * sizeof(FreeNode) > threshold) Trim();
 }
 
 Node::Pool gNodePool;
@@ -190,22 +326,21 @@ Node* Node::CreateChild(Move m) {
   new_node->sibling_ = child_;
   new_node->move_ = m;
   child_ = new_node;
+  ++num_children_;
   return new_node;
 }
 
-float Node::GetVisitedPolicy() const {
-  float res = 0.0f;
-  for (const Node* node : Children()) {
-    if (node->GetNStarted() > 0) res += node->GetP();
-  }
-  return res;
+void Node::SetP(float val) {
+  // Normally P is set before the first visit, but keep parent's sum correct
+  // if it's not (e.g. noise added to an already visited node).
+  if (parent_ && GetNStarted() > 0) parent_->visited_policy_ += val - p_;
+  p_ = val;
 }
 
 void Node::ResetStats() {
   n_in_flight_ = 0;
   n_ = 0;
   v_ = 0.0;
-  q_ = 0.0;
   w_ = 0.0;
   p_ = 0.0;
   max_depth_ = 0;
@@ -217,7 +352,8 @@ std::string Node::DebugString() const {
   std::ostringstream oss;
   oss << "Move: " << move_.as_string() << " Term:" << is_terminal_
       << " This:" << this << " Parent:" << parent_ << " child:" << child_
-      << " sibling:" << sibling_ << " P:" << p_ << " Q:" << q_ << " W:" << w_
+      << " sibling:" << sibling_ << " P:" << p_ << " Q:" << GetQ(0, 0)
+      << " W:" << w_
       << " N:" << n_ << " N_:" << n_in_flight_;
   return oss.str();
 }
@@ -236,21 +372,32 @@ void Node::MakeTerminal(GameResult result) {
 
 bool Node::TryStartScoreUpdate() {
   if (n_ == 0 && n_in_flight_ > 0) return false;
+  if (n_ == 0 && parent_) parent_->visited_policy_ += p_;
   ++n_in_flight_;
   return true;
 }
 
-void Node::CancelScoreUpdate() { --n_in_flight_; }
+void Node::CancelScoreUpdate() {
+  --n_in_flight_;
+  if (n_ == 0 && n_in_flight_ == 0 && parent_) parent_->visited_policy_ -= p_;
+}
 
-void Node::FinalizeScoreUpdate(float v) {
+void Node::FinalizeScoreUpdate(float v, int visits) {
   // Add new value to W.
   w_ += v;
   // Increment N.
-  ++n_;
+  n_ += visits;
   // Decrement virtual loss.
-  --n_in_flight_;
-  // Recompute Q.
-  q_ = w_ / n_;
+  n_in_flight_ -= visits;
+  // Q of the best child only changes together with its N, so comparing with
+  // it on every update of a sibling keeps it the best.
+  if (parent_ && parent_->best_child_ != this) {
+    const Node* best = parent_->best_child_;
+    if (!best || std::make_tuple(n_, GetQ(0, 0), p_) >
+                     std::make_tuple(best->n_, best->GetQ(0, 0), best->p_)) {
+      parent_->best_child_ = this;
+    }
+  }
 }
 
 void Node::UpdateMaxDepth(int depth) {
@@ -337,6 +484,7 @@ void NodeTree::MakeMove(Move move) {
   gNodePool.ReleaseAllChildrenExceptOne(current_head_, new_head);
   current_head_ = new_head ? new_head : current_head_->CreateChild(move);
   history_.Append(move);
+  gNodePool.MaybeTrim();
 }
 
 void NodeTree::ResetToPosition(const std::string& starting_fen,
@@ -374,12 +522,20 @@ void NodeTree::ResetToPosition(const std::string& starting_fen,
     gNodePool.ReleaseChildren(current_head_);
     current_head_->ResetStats();
   }
+  gNodePool.MaybeTrim();
 }
 
 void NodeTree::DeallocateTree() {
   gNodePool.ReleaseSubtree(gamebegin_node_);
   gamebegin_node_ = nullptr;
   current_head_ = nullptr;
+  gNodePool.MaybeTrim();
+}
+
+void NodeTree::TrimNodePool() { gNodePool.Trim(); }
+
+void NodeTree::SetNodePoolTrimThreshold(size_t bytes) {
+  gNodePool.SetTrimThreshold(bytes);
 }
 
 }  // namespace lczero
\ No newline at end of file
@@ -64,7 +64,13 @@ class Node {
   Move GetMove(bool flip) const;
 
   // Returns sum of probabilities for visited children.
-  float GetVisitedPolicy() const;
+  float GetVisitedPolicy() const { return visited_policy_; }
+  // Returns number of children.
+  int GetNumChildren() const { return num_children_; }
+  // Returns child with most completed visits (ties are resolved by larger Q,
+  // then by larger P), or nullptr if no child has completed visits. Kept up
+  // to date by FinalizeScoreUpdate() of children, so that it's O(1).
+  Node* GetBestChild() const { return best_child_; }
   uint32_t GetN() const { return n_; }
   uint32_t GetNInFlight() const { return n_in_flight_; }
   uint32_t GetChildrenVisits() const { return n_ > 0 ? n_ - 1 : 1; }
@@ -77,7 +83,7 @@ class Node {
       return (w_ - n_in_flight_ * virtual_loss) /
              (n_ + n_in_flight_ * virtual_loss);
     } else {
-      return q_;
+      return w_ / n_;
     }
   }
   // Returns U / (Puct * N[parent])
@@ -95,7 +101,7 @@ class Node {
   // Sets node own value (from neural net or win/draw/lose adjudication).
   void SetV(float val) { v_ = val; }
   // Sets move probability.
-  void SetP(float val) { p_ = val; }
+  void SetP(float val);
   // Makes the node terminal and sets it's score.
   void MakeTerminal(GameResult result);
 
@@ -106,13 +112,18 @@ class Node {
   bool TryStartScoreUpdate();
   // Decrements n-in-flight back.
   void CancelScoreUpdate();
-  // Updates the node with newly computed value v.
+  // Adds more in-flight visits to a node which already has one started by
+  // TryStartScoreUpdate().
+  void IncrementNInFlight(int visits) { n_in_flight_ += visits; }
+  // Updates the node with newly computed value v, or with @visits visits
+  // which values sum up to v.
   // Updates:
-  // * N (+=1)
-  // * N-in-flight (-=1)
+  // * N (+=visits)
+  // * N-in-flight (-=visits)
   // * W (+= v)
   // * Q (=w/n)
-  void FinalizeScoreUpdate(float v);
+  // * Best child of the parent, if this node overtakes it.
+  void FinalizeScoreUpdate(float v, int visits = 1);
 
   // Updates max depth, if new depth is larger.
   void UpdateMaxDepth(int depth);
@@ -144,43 +155,51 @@ class Node {
   class Pool;
 
  private:
-  // Move corresponding to this node. From the point of view of a player,
-  // i.e. black's e7e5 is stored as e2e4.
-  // Root node contains move a1a1.
-  Move move_;
+  // Fields are ordered by how often they are accessed: the first ones are
+  // read for every child during selection, the rest mostly during backup and
+  // expansion. The whole node is exactly one cache line, see Node::Pool.
 
-  // Q value fetched from neural network.
-  float v_;
-  // Average value (from value head of neural network) of all visited nodes in
-  // subtree. Terminal nodes (which lead to checkmate or draw) may be visited
-  // several times, those are counted several times. q = w / n
-  float q_;
-  // Sum of values of all visited nodes in a subtree. Used to compute an
-  // average.
-  float w_;
+  // Pointer to a first child. nullptr for leave node.
+  Node* child_;
+  // Pointer to a next sibling. nullptr if there are no further siblings.
+  Node* sibling_;
   // Probabality that this move will be made. From policy head of the neural
   // network.
   float p_;
+  // Sum of values of all visited nodes in a subtree. Terminal nodes (which
+  // lead to checkmate or draw) may be visited several times, those are
+  // counted several times. Q is not stored to keep the node in one cache
+  // line, q = w / n.
+  float w_;
   // How many completed visits this node had.
   uint32_t n_;
+  // Sum of P of children which have been visited (or have a visit in flight),
+  // kept up to date when a child gets its first visit, so that FPU doesn't
+  // need a pass over children.
+  float visited_policy_;
   // (aka virtual loss). How many threads currently process this node (started
   // but not finished). This value is added to n during selection which node
   // to pick in MCTS, and also when selecting the best move.
   uint16_t n_in_flight_;
+  // Number of children. There are at most 218 legal moves in chess.
+  uint8_t num_children_;
+  // Does this node end game (with a winning of either sides or draw).
+  bool is_terminal_;
 
+  // Q value fetched from neural network.
+  float v_;
+  // Move corresponding to this node. From the point of view of a player,
+  // i.e. black's e7e5 is stored as e2e4.
+  // Root node contains move a1a1.
+  Move move_;
   // Maximum depth any subnodes of this node were looked at.
   uint16_t max_depth_;
   // Complete depth all subnodes of this node were fully searched.
   uint16_t full_depth_;
-  // Does this node end game (with a winning of either sides or draw).
-  bool is_terminal_;
-
   // Pointer to a parent node. nullptr for the root.
   Node* parent_;
-  // Pointer to a first child. nullptr for leave node.
-  Node* child_;
-  // Pointer to a next sibling. nullptr if there are no further siblings.
-  Node* sibling_;
+  // Child with most completed visits, see GetBestChild().
+  Node* best_child_;
 
   // TODO(mooskagh) Unfriend both NodeTree and Node::Pool.
   friend class NodeTree;
@@ -204,6 +223,14 @@ class NodeTree {
   Node* GetGameBeginNode() const { return gamebegin_node_; }
   const PositionHistory& GetPositionHistory() const { return history_; }
 
+  // Returns memory of node pool batches which have no nodes in use to the
+  // OS, as otherwise the process keeps memory of the largest tree it ever
+  // searched.
+  static void TrimNodePool();
+  // Makes node pool trim itself when more than @bytes of node memory are free
+  // after a tree is cut. 0 disables.
+  static void SetNodePoolTrimThreshold(size_t bytes);
+
  private:
   void DeallocateTree();
   Node* current_head_ = nullptr;
@@ -0,0 +1,127 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2018 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "mcts/node.h"
+#include "utils/largepages.h"
+#include "utils/metrics.h"
+#include "utils/mutex.h"
+
+namespace lczero {
+
+// Allocator of tree nodes. Search uses the one global pool through Node and
+// NodeTree, it's declared here to be tested separately.
+class Node::Pool {
+ public:
+  // Has an arena for every NUMA node of the machine.
+  Pool();
+  explicit Pool(int max_arenas);
+
+  // Allocates a new node and initializes it with all zeros. Takes it from the
+  // arena of NUMA node the calling thread is pinned to.
+  Node* AllocateNode();
+  // Same, but takes the node from @arena, which must be below max_arenas.
+  Node* AllocateNode(int arena);
+  // Return node to the pool.
+  void ReleaseNode(Node*);
+
+  // Releases all children of the node, except specified. Also updates pointers
+  // accordingly.
+  void ReleaseAllChildrenExceptOne(Node* root, Node* subtree);
+  // Releases all children, but doesn't release the node isself.
+  void ReleaseChildren(Node*);
+  // Releases all children and the node itself;
+  void ReleaseSubtree(Node*);
+
+  // Returns batches which have no nodes in use to the OS.
+  void Trim();
+  // Trims if more than threshold of node memory is free, unless the last
+  // trim left that much free already (e.g. when few nodes in use keep many
+  // batches).
+  void MaybeTrim();
+  void SetTrimThreshold(size_t bytes) { trim_threshold_ = bytes; }
+
+ private:
+  union FreeNode {
+    FreeNode* next;
+    Node node;
+
+    FreeNode() {}
+  };
+
+  struct Batch {
+    // Page aligned, and backed by large pages if enabled, as selection
+    // touches nodes all over the tree.
+    PageAllocation memory;
+    // Index of free and reserve list the nodes go to.
+    int arena;
+  };
+
+  void AllocateNewBatch(int arena);
+  // Returns index in batches_ of the batch which contains @node.
+  size_t BatchOf(const FreeNode* node) const;
+  // Calls @release with mutex_ held. Only if nodes of several arenas have to
+  // be told apart, also holds allocations_mutex_ and lets @release look up
+  // batches of nodes.
+  void ReleaseWithLocks(Node* node, void (Pool::*release)(Node*, bool));
+  // With @by_batch, requires allocations_mutex_ too.
+  void ReleaseNodeInternal(Node*, bool by_batch);
+  void ReleaseChildrenInternal(Node*, bool by_batch);
+  void ReleaseSubtreeInternal(Node*, bool by_batch);
+
+  // There is an arena of nodes for every NUMA node threads are pinned to,
+  // so that they allocate nodes from local memory. Released nodes go back to
+  // the arena of their batch. The pool is created before options are known,
+  // so lists are allocated for all NUMA nodes of the machine, but only the
+  // first GetNumaNodeCount() are used.
+  const int max_arenas_;
+
+  mutable Mutex mutex_;
+  // Linked lists of free nodes, one per arena.
+  std::vector<FreeNode*> free_lists_ GUARDED_BY(mutex_);
+  // Number of nodes currently given out.
+  int64_t nodes_in_use_ GUARDED_BY(mutex_) = 0;
+
+  // Mutex for slow but rare operations.
+  mutable Mutex allocations_mutex_ ACQUIRED_AFTER(mutex_);
+  std::vector<FreeNode*> reserve_lists_ GUARDED_BY(allocations_mutex_);
+  // Sorted by address.
+  std::vector<Batch> batches_ GUARDED_BY(allocations_mutex_);
+  // Whether arenas other than the first one have batches, otherwise there's
+  // no need to lock allocations_mutex_ and look up batches of released nodes.
+  // Only set under allocations_mutex_, before nodes of such batch are given
+  // out.
+  std::atomic<bool> multiple_arenas_{false};
+  // Size of batches_, to check free memory without allocations_mutex_.
+  std::atomic<int64_t> num_batches_{0};
+
+  // Free node memory above which pool trims itself, 0 if it doesn't.
+  std::atomic<size_t> trim_threshold_{0};
+  // Free nodes which the last trim couldn't release.
+  int64_t free_nodes_after_trim_ GUARDED_BY(mutex_) = 0;
+  int64_t trimmed_bytes_ GUARDED_BY(mutex_) = 0;
+
+  std::vector<Metrics::Registration> metrics_;
+};
+
+}  // namespace lczero
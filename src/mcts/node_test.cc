@@ -0,0 +1,76 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2018 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "mcts/node_pool.h"
+#include <gtest/gtest.h>
+
+namespace lczero {
+
+TEST(NodePool, SingleArenaReusesReleasedNodes) {
+  Node::Pool pool(1);
+  Node* a = pool.AllocateNode(0);
+  Node* b = pool.AllocateNode(0);
+  EXPECT_NE(a, b);
+  pool.ReleaseNode(a);
+  EXPECT_EQ(pool.AllocateNode(0), a);
+  EXPECT_EQ(a->GetN(), 0u);
+  pool.ReleaseNode(a);
+  pool.ReleaseNode(b);
+}
+
+TEST(NodePool, ReleasedNodesReturnToTheirArena) {
+  Node::Pool pool(2);
+  Node* a = pool.AllocateNode(0);
+  Node* b = pool.AllocateNode(1);
+  EXPECT_NE(a, b);
+
+  // A node of the second arena is not given out from the first one.
+  pool.ReleaseNode(b);
+  Node* c = pool.AllocateNode(0);
+  EXPECT_NE(c, b);
+  EXPECT_EQ(pool.AllocateNode(1), b);
+
+  pool.ReleaseNode(a);
+  EXPECT_NE(pool.AllocateNode(1), a);
+  EXPECT_EQ(pool.AllocateNode(0), a);
+}
+
+TEST(NodePool, TrimKeepsNodesInUse) {
+  Node::Pool pool(2);
+  std::vector<Node*> nodes;
+  for (int i = 0; i < 1000; ++i) nodes.push_back(pool.AllocateNode(i % 2));
+  Node* kept = nodes.back();
+  nodes.pop_back();
+  for (Node* node : nodes) pool.ReleaseNode(node);
+  pool.Trim();
+
+  // The kept node's batch stays, and its free nodes are still given out.
+  Node* node = pool.AllocateNode(1);
+  EXPECT_NE(node, kept);
+  pool.ReleaseNode(node);
+  pool.ReleaseNode(kept);
+  pool.Trim();
+  EXPECT_NE(pool.AllocateNode(0), nullptr);
+}
+
+}  // namespace lczero
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -19,16 +19,21 @@
 #include "mcts/search.h"
 
 #include <algorithm>
+#include <atomic>
 #include <chrono>
 #include <cmath>
 #include <iomanip>
 #include <iostream>
 #include <sstream>
 #include <thread>
+#include <unordered_map>
 
 #include "mcts/node.h"
 #include "neural/cache.h"
 #include "neural/encoder.h"
+#include "utils/hashcat.h"
+#include "utils/metrics.h"
+#include "utils/numa.h"
 #include "utils/random.h"
 
 namespace lczero {
@@ -47,10 +52,82 @@ const char* Search::kCacheHistoryLengthStr =
     "Length of history to include in cache";
 const char* Search::kExtraVirtualLossStr = "Extra virtual loss";
 const char* Search::KPolicySoftmaxTempStr = "Policy softmax temperature";
+const char* Search::kDeterministicStr = "Deterministic search";
+const char* Search::kMultiVisitDescentStr = "Multi-visit tree descent";
+const char* Search::kOutOfOrderEvalStr = "Out-of-order NN evaluation";
+const char* Search::kConcurrentBatchesStr =
+    "Concurrent NN batches in out-of-order mode";
+const char* Search::kAdaptiveVirtualLossStr = "Adaptive virtual loss";
 
 namespace {
 const int kSmartPruningToleranceNodes = 100;
 const int kSmartPruningToleranceMs = 200;
+// Adaptive virtual loss is raised by this factor (plus a small constant to
+// get away from zero) when a collision leaves a minibatch less than
+// kVirtualLossTargetFill full, and is decayed by the other factor after other
+// minibatches. Aiming at completely full minibatches would spread visits too
+// widely in small trees.
+const float kVirtualLossTargetFill = 0.75f;
+const float kVirtualLossRaiseFactor = 1.2f;
+const float kVirtualLossRaiseStep = 0.01f;
+const float kVirtualLossDecayFactor = 0.99f;
+const float kMaxAdaptiveVirtualLoss = 10.0f;
+
+// Stats of all searches in the process, for metrics export.
+struct SearchMetrics {
+  SearchMetrics() {
+    auto* metrics = Metrics::Get();
+    registrations.push_back(metrics->AddCounter(
+        "lc0_search_playouts_total", "Number of playouts of all searches.",
+        [this]() { return playouts.load(); }));
+    registrations.push_back(metrics->AddGauge(
+        "lc0_search_nps", "Nodes per second of the last reported search.",
+        [this]() { return nps.load(); }));
+    registrations.push_back(
+        metrics->AddHistogram("lc0_search_batch_size",
+                              "Number of nodes gathered per minibatch.",
+                              &batch_size));
+    registrations.push_back(metrics->AddHistogram(
+        "lc0_search_nn_batch_size",
+        "Number of positions sent to NN per minibatch (cache misses).",
+        &nn_batch_size));
+    registrations.push_back(metrics->AddCounter(
+        "lc0_search_collisions_total",
+        "Number of minibatches which were cut short by a collision.",
+        [this]() { return collisions.load(); }));
+    registrations.push_back(metrics->AddGauge(
+        "lc0_search_virtual_loss",
+        "Virtual loss used by the last adjusted search.",
+        [this]() { return virtual_loss.load(); }));
+    registrations.push_back(metrics->AddHistogram(
+        "lc0_nn_latency_seconds",
+        "Time to evaluate one minibatch by NN backend.", &nn_latency));
+    for (const char* quantile : {"0.5", "0.9", "0.99"}) {
+      const double q = std::stod(quantile);
+      registrations.push_back(metrics->AddGauge(
+          "lc0_nn_latency_quantile_seconds",
+          "Estimated quantiles of NN minibatch evaluation time.",
+          [this, q]() { return nn_latency.GetQuantile(q); },
+          std::string("quantile=\"") + quantile + "\""));
+    }
+  }
+
+  std::atomic<int64_t> playouts{0};
+  std::atomic<int64_t> nps{0};
+  std::atomic<int64_t> collisions{0};
+  std::atomic<float> virtual_loss{0.0f};
+  Metrics::Histogram batch_size{{1, 2, 4, 8, 16, 32, 64, 128, 256, 512, 1024}};
+  Metrics::Histogram nn_batch_size{
+      {1, 2, 4, 8, 16, 32, 64, 128, 256, 512, 1024}};
+  Metrics::Histogram nn_latency{{0.0005, 0.001, 0.002, 0.005, 0.01, 0.02,
+                                 0.05, 0.1, 0.2, 0.5, 1.0, 2.0}};
+  std::vector<Metrics::Registration> registrations;
+};
+
+SearchMetrics* GetSearchMetrics() {
+  static SearchMetrics metrics;
+  return &metrics;
+}
 }  // namespace
 
 void Search::PopulateUciParams(OptionsParser* options) {
@@ -71,6 +148,14 @@ void Search::PopulateUciParams(OptionsParser* options) {
   options->Add<FloatOption>(kExtraVirtualLossStr, 0.0, 100.0,
                             "extra-virtual-loss") = 0.0f;
   options->Add<FloatOption>(KPolicySoftmaxTempStr, 0.1, 10.0, "policy-softmax-temp") = 1.0f;
+  options->Add<BoolOption>(kDeterministicStr, "deterministic") = false;
+  options->Add<BoolOption>(kMultiVisitDescentStr, "multivisit-descent") =
+      false;
+  options->Add<BoolOption>(kOutOfOrderEvalStr, "out-of-order-eval") = false;
+  options->Add<IntOption>(kConcurrentBatchesStr, 1, 64,
+                          "concurrent-batches") = 1;
+  options->Add<BoolOption>(kAdaptiveVirtualLossStr, "adaptive-virtual-loss") =
+      false;
 }
 
 Search::Search(const NodeTree& tree, Network* network,
@@ -84,6 +169,7 @@ Search::Search(const NodeTree& tree, Network* network,
       limits_(limits),
       start_time_(std::chrono::steady_clock::now()),
       initial_visits_(root_node_->GetN()),
+      search_id_(Random::Get().GetUint64()),
       best_move_callback_(best_move_callback),
       info_callback_(info_callback),
       kMiniBatchSize(options.Get<int>(kMiniBatchSizeStr)),
@@ -98,24 +184,39 @@ Search::Search(const NodeTree& tree, Network* network,
       kFpuReduction(options.Get<float>(kFpuReductionStr)),
       kCacheHistoryLength(options.Get<int>(kCacheHistoryLengthStr)),
       kExtraVirtualLoss(options.Get<float>(kExtraVirtualLossStr)),
-      KPolicySoftmaxTemp(options.Get<float>(KPolicySoftmaxTempStr)) {}
+      KPolicySoftmaxTemp(options.Get<float>(KPolicySoftmaxTempStr)),
+      kDeterministic(options.Get<bool>(kDeterministicStr)),
+      kMultiVisitDescent(options.Get<bool>(kMultiVisitDescentStr)),
+      // Order of completion depends on timing.
+      kOutOfOrderEval(options.Get<bool>(kOutOfOrderEvalStr) &&
+                      !kDeterministic),
+      kConcurrentBatches(options.Get<int>(kConcurrentBatchesStr)),
+      kAdaptiveVirtualLoss(options.Get<bool>(kAdaptiveVirtualLossStr)) {
+  virtual_loss_ = kExtraVirtualLoss;
+  if (kOutOfOrderEval) {
+    eval_queue_ = std::make_unique<EvalQueue>(network_, cache_, kMiniBatchSize,
+                                              kConcurrentBatches);
+  }
+}
 
 // Returns whether node was already in cache.
 bool Search::AddNodeToCompute(Node* node, CachingComputation* computation,
-                              const PositionHistory& history,
-                              bool add_if_cached) {
+                              const PositionHistory& history) {
   auto hash = history.HashLast(kCacheHistoryLength + 1);
   // If already in cache, no need to do anything.
-  if (add_if_cached) {
-    if (computation->AddInputByHash(hash)) return true;
-  } else {
-    if (cache_->ContainsKey(hash)) return true;
-  }
+  if (computation->AddInputByHash(hash)) return true;
+  AddPositionToCompute(hash, node, computation, history);
+  return false;
+}
+
+void Search::AddPositionToCompute(uint64_t hash, const Node* node,
+                                  CachingComputation* computation,
+                                  const PositionHistory& history) {
   auto planes = EncodePositionForNN(history, 8);
 
   std::vector<uint16_t> moves;
 
-  if (node->HasChildren()) {
+  if (node && node->HasChildren()) {
     // Legal moves are known, using them.
     for (Node* iter : node->Children()) {
       moves.emplace_back(iter->GetMove().as_nn_index());
@@ -133,16 +234,15 @@ bool Search::AddNodeToCompute(Node* node, CachingComputation* computation,
     }
   }
 
-  computation->AddInput(hash, std::move(planes), std::move(moves));
-  return false;
+  computation->AddUncachedInput(hash, std::move(planes), std::move(moves));
 }
 
 namespace {
 void ApplyDirichletNoise(Node* node, float eps, double alpha) {
   float total = 0;
   std::vector<float> noise;
+  noise.reserve(node->GetNumChildren());
 
-  // TODO(mooskagh) remove this loop when we store number of children.
   for (Node* iter : node->Children()) {
     (void)iter;  // Silence the unused variable warning.
     float eta = Random::Get().GetGamma(alpha, 1.0);
@@ -159,9 +259,131 @@ void ApplyDirichletNoise(Node* node, float eps, double alpha) {
 }
 }  // namespace
 
-void Search::Worker() {
+// Stats of children of a node, stored as separate arrays so that scores of
+// all children are computed in a single loop without branches, which the
+// compiler can vectorize.
+struct Search::ChildStats {
+  // Resizes arrays to hold at least @size children.
+  void Reserve(size_t size) {
+    if (nodes.size() >= size) return;
+    nodes.resize(size);
+    p.resize(size);
+    n_started.resize(size);
+    q.resize(size);
+    is_visited.resize(size);
+    scores.resize(size);
+  }
+
+  std::vector<Node*> nodes;
+  std::vector<float> p;
+  std::vector<float> n_started;
+  // Q of a child, only meaningful if the child is visited.
+  std::vector<float> q;
+  // Whether the child has completed visits (N > 0), stored as float to keep
+  // the scoring loop free of type conversions.
+  std::vector<float> is_visited;
+  std::vector<float> scores;
+
+  // Scores of children for multi-visit descent, shared by all levels of
+  // recursion.
+  std::vector<std::pair<float, Node*>> multivisit_scores;
+  // Moves from the search root to a node.
+  std::vector<Move> path;
+
+  // Buffers for prefetch, which are reused between calls so that prefetch
+  // doesn't allocate.
+  std::vector<std::pair<float, Node*>> prefetch_scores;
+  // Negated priors and NN indices of moves of a cached position.
+  std::vector<std::pair<float, uint16_t>> prefetch_replies;
+};
+
+// Updates of all nodes touched by a minibatch, merged so that nodes on
+// shared paths are updated once per minibatch rather than once per visit.
+struct Search::BackupUpdates {
+  struct Update {
+    Node* node;
+    // Index of the parent's update, -1 for the search root.
+    int parent_idx;
+    // Distance from the search root.
+    int depth;
+    // Number of visits which went through the node.
+    int visits;
+    // Sum of values of those visits, from the point of view of the node.
+    float v;
+    // Maximum depth the node is explored by those visits, counting the node.
+    uint16_t max_depth;
+    // Whether full depth of the node has to be recomputed, and the full depth
+    // reported by a visited child (or by the visit itself for a leaf).
+    bool full_depth_updated;
+    uint16_t full_depth;
+  };
+
+  std::vector<Update> updates;
+  std::unordered_map<Node*, int> index;
+  // Indices of updates, deepest first.
+  std::vector<int> order;
+};
+
+template <typename GetP>
+void Search::SetEvaluation(Node* node, float q, GetP get_p) {
+  // Populate Q value.
+  node->SetV(-q);
+  // Populate P values.
+  float total = 0.0;
+  int idx = 0;
+  for (Node* n : node->Children()) {
+    float p = get_p(idx++, n->GetMove().as_nn_index());
+    if(KPolicySoftmaxTemp != 1.0f){
+        p = pow(p, 1/KPolicySoftmaxTemp);
+    }
+    total += p;
+    n->SetP(p);
+  }
+  // Scale P values to add up to 1.0.
+  if (total > 0.0f) {
+    float scale = 1.0f / total;
+    for (Node* n : node->Children()) n->SetP(n->GetP() * scale);
+  }
+  // Add Dirichlet noise if enabled and at root.
+  if (kNoise && node == root_node_) {
+    ApplyDirichletNoise(node, 0.25, 0.3);
+  }
+}
+
+void Search::SetEvaluation(Node* node, const CachingComputation& computation,
+                           int sample, std::vector<uint16_t>* moves,
+                           std::vector<float>* priors) {
+  moves->clear();
+  for (Node* child : node->Children()) {
+    moves->push_back(child->GetMove().as_nn_index());
+  }
+  priors->resize(moves->size());
+  const float q = computation.GetQAndPVals(sample, *moves, priors->data());
+  SetEvaluation(node, q, [priors](int idx, uint16_t) { return (*priors)[idx]; });
+}
+
+void Search::Worker(int thread_idx) {
+  if (kDeterministic) {
+    // Seed depends only on the position (and the global seed if it's set).
+    Random::Get().Seed(
+        HashCat({Random::GetSeed(),
+                 played_history_.HashLast(played_history_.GetLength())}));
+  } else {
+    // Seed depends on the search and the worker rather than on the thread.
+    Random::Get().Reseed({search_id_, static_cast<uint64_t>(thread_idx)});
+  }
+
+  if (kOutOfOrderEval) {
+    AsyncWorker();
+    return;
+  }
   std::vector<Node*> nodes_to_process;
   PositionHistory history(played_history_);
+  ChildStats child_stats;
+  BackupUpdates backup_updates;
+  // Scratch buffers for SetEvaluation().
+  std::vector<uint16_t> child_moves;
+  std::vector<float> child_priors;
 
   // Exit check is at the end of the loop as at least one iteration is
   // necessary.
@@ -169,16 +391,40 @@ void Search::Worker() {
     nodes_to_process.clear();
     auto computation = CachingComputation(network_->NewComputation(), cache_);
 
+    // Whether a collision prevented gathering the full minibatch.
+    bool collided = false;
     // Gather nodes to process in the current batch.
-    for (int i = 0; i < kMiniBatchSize; ++i) {
+    if (kMultiVisitDescent) {
+      {
+        SharedMutex::Lock lock(nodes_mutex_);
+        PickNodesToExtend(root_node_, kMiniBatchSize, true, &child_stats,
+                          &nodes_to_process);
+      }
+      for (Node* node : nodes_to_process) {
+        // Terminal leaves may be visited several times, and were visited
+        // before.
+        if (node->IsTerminal()) continue;
+        SetHistoryToNode(node, &history, &child_stats);
+        ExtendNode(node, history);
+        if (!node->IsTerminal()) {
+          AddNodeToCompute(node, &computation, history);
+        }
+      }
+      collided = static_cast<int>(nodes_to_process.size()) < kMiniBatchSize;
+    }
+    for (int i = 0; !kMultiVisitDescent && i < kMiniBatchSize; ++i) {
       // Initialize position sequence with pre-move position.
       history.Trim(played_history_.GetLength());
       // If there's something to do without touching slow neural net, do it.
-      if (i > 0 && computation.GetCacheMisses() == 0) break;
-      Node* node = PickNodeToExtend(root_node_, &history);
+      // Not in deterministic mode, as cache contents depend on history.
+      if (!kDeterministic && i > 0 && computation.GetCacheMisses() == 0) break;
+      Node* node = PickNodeToExtend(root_node_, &history, &child_stats);
       // If we hit the node that is already processed (by our batch or in
       // another thread) stop gathering and process smaller batch.
-      if (!node) break;
+      if (!node) {
+        collided = true;
+        break;
+      }
 
       nodes_to_process.push_back(node);
       // If node is already known as terminal (win/lose/draw according to rules
@@ -194,82 +440,46 @@ void Search::Worker() {
       }
     }
 
+    UpdateVirtualLoss(nodes_to_process.size(), collided);
+
     // If there are requests to NN, but the batch is not full, try to prefetch
     // nodes which are likely useful in future.
-    if (computation.GetCacheMisses() > 0 &&
+    if (!kDeterministic && computation.GetCacheMisses() > 0 &&
         computation.GetCacheMisses() < kMiniPrefetchBatch) {
       history.Trim(played_history_.GetLength());
       SharedMutex::SharedLock lock(nodes_mutex_);
       PrefetchIntoCache(root_node_,
                         kMiniPrefetchBatch - computation.GetCacheMisses(),
-                        &computation, &history);
+                        &computation, &history, &child_stats);
     }
 
     // Evaluate nodes through NN.
     if (computation.GetBatchSize() != 0) {
+      const auto compute_start = std::chrono::steady_clock::now();
       computation.ComputeBlocking();
+      if (computation.GetCacheMisses() != 0) {
+        auto* metrics = GetSearchMetrics();
+        metrics->nn_batch_size.Add(computation.GetCacheMisses());
+        metrics->nn_latency.Add(std::chrono::duration<double>(
+                                    std::chrono::steady_clock::now() -
+                                    compute_start)
+                                    .count());
+      }
 
       int idx_in_computation = 0;
       for (Node* node : nodes_to_process) {
         if (node->IsTerminal()) continue;
-        // Populate Q value.
-        node->SetV(-computation.GetQVal(idx_in_computation));
-        // Populate P values.
-        float total = 0.0;
-        for (Node* n : node->Children()) {
-          float p = computation.GetPVal(idx_in_computation,
-                                        n->GetMove().as_nn_index());
-          if(KPolicySoftmaxTemp != 1.0f){
-              p = pow(p, 1/KPolicySoftmaxTemp);
-          }
-          total += p;
-          n->SetP(p);
-        }
-        // Scale P values to add up to 1.0.
-        if (total > 0.0f) {
-          float scale = 1.0f / total;
-          for (Node* n : node->Children()) n->SetP(n->GetP() * scale);
-        }
-        // Add Dirichlet noise if enabled and at root.
-        if (kNoise && node == root_node_) {
-          ApplyDirichletNoise(node, 0.25, 0.3);
-        }
-        ++idx_in_computation;
+        SetEvaluation(node, computation, idx_in_computation++, &child_moves,
+                      &child_priors);
       }
     }
 
-    {
-      // Update nodes.
-      SharedMutex::Lock lock(nodes_mutex_);
-      for (Node* node : nodes_to_process) {
-        float v = node->GetV();
-        // Maximum depth the node is explored.
-        uint16_t depth = 0;
-        // If the node is terminal, mark it as fully explored to an infinite
-        // depth.
-        uint16_t cur_full_depth = node->IsTerminal() ? 999 : 0;
-        bool full_depth_updated = true;
-        for (Node* n = node; n != root_node_->GetParent(); n = n->GetParent()) {
-          ++depth;
-          n->FinalizeScoreUpdate(v);
-          // Q will be flipped for opponent.
-          v = -v;
-
-          // Updating stats.
-          // Max depth.
-          n->UpdateMaxDepth(depth);
-          // Full depth.
-          if (full_depth_updated)
-            full_depth_updated = n->UpdateFullDepth(&cur_full_depth);
-          // Best move.
-          if (n->GetParent() == root_node_) {
-            if (!best_move_node_ || best_move_node_->GetN() < n->GetN()) {
-              best_move_node_ = n;
-            }
-          }
-        }
-      }
-      total_playouts_ += nodes_to_process.size();
+    // Update nodes.
+    DoBackupUpdate(nodes_to_process, &backup_updates);
+    if (!nodes_to_process.empty()) {
+      auto* metrics = GetSearchMetrics();
+      metrics->playouts += nodes_to_process.size();
+      metrics->batch_size.Add(nodes_to_process.size());
     }
     UpdateRemainingMoves();  // Update remaining moves using smart pruning.
     MaybeOutputInfo();
@@ -287,65 +497,166 @@ void Search::Worker() {
   }
 }  // namespace lczero
 
+void Search::AsyncWorker() {
+  std::vector<Node*> nodes_to_process;
+  std::vector<Node*> cached_nodes;
+  std::vector<EvalQueue::Evaluation> evaluations;
+  PositionHistory history(played_history_);
+  ChildStats child_stats;
+  BackupUpdates backup_updates;
+  // Scratch buffers for SetEvaluation().
+  std::vector<uint16_t> child_moves;
+  std::vector<float> child_priors;
+  // One more batch is gathered while all concurrent ones are computed.
+  const int max_in_flight = (kConcurrentBatches + 1) * kMiniBatchSize;
+  bool stopping = false;
+
+  // Leaves which are still in the queue have to be backed up even after the
+  // search is stopped, so the loop continues until all of them are taken.
+  while (!stopping || eval_queue_->GetInFlight() > 0) {
+    nodes_to_process.clear();
+    cached_nodes.clear();
+    evaluations.clear();
+    auto cached = CachingComputation(network_->NewComputation(), cache_);
+
+    // Gather leaves while there is room in the queue. Unlike Worker(), NN
+    // evaluations don't have to be waited for right away, so gathering stops
+    // only at collision.
+    bool collided = false;
+    int gathered = 0;
+    for (int i = 0; !stopping && i < kMiniBatchSize &&
+                    eval_queue_->GetInFlight() < max_in_flight;
+         ++i) {
+      history.Trim(played_history_.GetLength());
+      Node* node = PickNodeToExtend(root_node_, &history, &child_stats);
+      if (!node) {
+        collided = true;
+        break;
+      }
+      ++gathered;
+      if (!node->IsTerminal()) ExtendNode(node, history);
+      if (node->IsTerminal()) {
+        nodes_to_process.push_back(node);
+        continue;
+      }
+      const auto hash = history.HashLast(kCacheHistoryLength + 1);
+      if (cached.AddInputByHash(hash)) {
+        cached_nodes.push_back(node);
+        continue;
+      }
+      std::vector<uint16_t> moves;
+      moves.reserve(node->GetNumChildren());
+      for (Node* iter : node->Children()) {
+        moves.emplace_back(iter->GetMove().as_nn_index());
+      }
+      eval_queue_->Submit(node, hash, EncodePositionForNN(history, 8),
+                          std::move(moves));
+    }
+
+    if (gathered > 0 || collided) UpdateVirtualLoss(gathered, collided);
+
+    for (size_t i = 0; i < cached_nodes.size(); ++i) {
+      SetEvaluation(cached_nodes[i], cached, i, &child_moves, &child_priors);
+      nodes_to_process.push_back(cached_nodes[i]);
+    }
+
+    // Take leaves evaluated so far, possibly submitted by other threads. If
+    // there is nothing else to back up, wait for some.
+    eval_queue_->TakeEvaluated(&evaluations, nodes_to_process.empty());
+    for (const auto& evaluation : evaluations) {
+      SetEvaluation(evaluation.node, evaluation.q,
+                    [&](int idx, uint16_t) { return evaluation.p[idx]; });
+      nodes_to_process.push_back(evaluation.node);
+    }
+
+    DoBackupUpdate(nodes_to_process, &backup_updates);
+    if (!nodes_to_process.empty()) {
+      auto* metrics = GetSearchMetrics();
+      metrics->playouts += nodes_to_process.size();
+      metrics->batch_size.Add(nodes_to_process.size());
+    }
+    UpdateRemainingMoves();
+    MaybeOutputInfo();
+    MaybeTriggerStop();
+
+    if (!stopping) {
+      Mutex::Lock lock(counters_mutex_);
+      stopping = stop_;
+    }
+    if (nodes_to_process.empty() && !stopping) {
+      // All leaves are taken by other threads.
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  }
+}
+
 // Prefetches up to @budget nodes into cache. Returns number of nodes
 // prefetched.
 int Search::PrefetchIntoCache(Node* node, int budget,
                               CachingComputation* computation,
-                              PositionHistory* history) {
+                              PositionHistory* history, ChildStats* scratch) {
   if (budget <= 0) return 0;
 
   // We are in a leaf, which is not yet being processed.
   if (node->GetNStarted() == 0) {
-    if (AddNodeToCompute(node, computation, *history, false)) {
-      // Make it return 0 to make it not use the slot, so that the function
-      // tries hard to find something to cache even among unpopular moves.
-      // In practice that slows things down a lot though, as it's not always
-      // easy to find what to cache.
+    const auto hash = history->HashLast(kCacheHistoryLength + 1);
+    NNCacheLock cached(cache_, hash);
+    if (!cached) {
+      AddPositionToCompute(hash, node, computation, *history);
       return 1;
     }
-    return 1;
+    // The leaf is already in cache, so its first visit won't need NN. Spend
+    // the rest of its budget on replies which will be visited next.
+    // (The leaf still uses a slot; making it free makes the function try
+    // hard to find something to cache even among unpopular moves, which in
+    // practice slows things down a lot.)
+    return 1 + PrefetchCachedReplies(**cached, budget - 1, computation,
+                                     history, scratch);
   }
 
   // If it's a node in progress of expansion or is terminal, not prefetching.
   if (!node->HasChildren()) return 0;
 
-  // Populate all subnodes and their scores.
-  typedef std::pair<float, Node*> ScoredNode;
-  std::vector<ScoredNode> scores;
+  // Populate all subnodes and their scores. Scores of all levels of recursion
+  // share one buffer, this level uses [begin, end).
+  auto& scores = scratch->prefetch_scores;
+  const size_t begin = scores.size();
   float factor = kCpuct * std::sqrt(std::max(node->GetChildrenVisits(), 1u));
+  const float virtual_loss = virtual_loss_.load(std::memory_order_relaxed);
   // FPU reduction is not taken into account.
-  const float parent_q = -node->GetQ(0, kExtraVirtualLoss);
+  const float parent_q = -node->GetQ(0, virtual_loss);
   for (Node* iter : node->Children()) {
     if (iter->GetP() == 0.0f) continue;
     // Flipping sign of a score to be able to easily sort.
     scores.emplace_back(
-        -factor * iter->GetU() - iter->GetQ(parent_q, kExtraVirtualLoss), iter);
+        -factor * iter->GetU() - iter->GetQ(parent_q, virtual_loss), iter);
   }
+  const size_t end = scores.size();
 
-  size_t first_unsorted_index = 0;
+  size_t first_unsorted_index = begin;
   int total_budget_spent = 0;
   int budget_to_spend = budget;  // Initializing for the case there's only
                                  // on child.
-  for (size_t i = 0; i < scores.size(); ++i) {
+  for (size_t i = begin; i < end; ++i) {
     if (budget <= 0) break;
 
     // Sort next chunk of a vector. 3 of a time. Most of the times it's fine.
-    if (first_unsorted_index != scores.size() &&
-        i + 2 >= first_unsorted_index) {
-      const int new_unsorted_index =
-          std::min(scores.size(), budget < 2 ? first_unsorted_index + 2
-                                             : first_unsorted_index + 3);
+    if (first_unsorted_index != end && i + 2 >= first_unsorted_index) {
+      const size_t new_unsorted_index =
+          std::min(end, budget < 2 ? first_unsorted_index + 2
+                                   : first_unsorted_index + 3);
       std::partial_sort(scores.begin() + first_unsorted_index,
-                        scores.begin() + new_unsorted_index, scores.end());
+                        scores.begin() + new_unsorted_index,
+                        scores.begin() + end);
       first_unsorted_index = new_unsorted_index;
     }
 
     Node* n = scores[i].second;
     // Last node gets the same budget as prev-to-last node.
-    if (i != scores.size() - 1) {
+    if (i != end - 1) {
       // Sign of the score was flipped for sorting, flipping back.
       const float next_score = -scores[i + 1].first;
-      const float q = n->GetQ(-parent_q, kExtraVirtualLoss);
+      const float q = n->GetQ(-parent_q, virtual_loss);
       if (next_score > q) {
         budget_to_spend = std::min(
             budget,
@@ -355,15 +666,62 @@ int Search::PrefetchIntoCache(Node* node, int budget,
       }
     }
     history->Append(n->GetMove());
+    // Deeper levels append to the buffer and truncate it back when done.
     const int budget_spent =
-        PrefetchIntoCache(n, budget_to_spend, computation, history);
+        PrefetchIntoCache(n, budget_to_spend, computation, history, scratch);
     history->Pop();
     budget -= budget_spent;
     total_budget_spent += budget_spent;
   }
+  scores.resize(begin);
   return total_budget_spent;
 }
 
+// Prefetches up to @budget replies to the last position of @history, which
+// is not expanded yet but which NN evaluation @request is in cache. Replies
+// are taken in order of their prior, as that is the order they get their
+// first visits in. Returns number of replies prefetched.
+int Search::PrefetchCachedReplies(const CachedNNRequest& request, int budget,
+                                  CachingComputation* computation,
+                                  PositionHistory* history,
+                                  ChildStats* scratch) {
+  if (budget <= 0) return 0;
+
+  // Cached moves are the moves of the position (possibly pseudolegal ones),
+  // so there is no need to generate them again.
+  auto& replies = scratch->prefetch_replies;
+  replies.clear();
+  for (int i = 0; i < request.p.size(); ++i) {
+    // Flipping sign of a prior to be able to easily sort.
+    const float prior = request.p[i].second;
+    if (prior > 0.0f) replies.emplace_back(-prior, request.p[i].first);
+  }
+
+  const size_t count = std::min<size_t>(budget, replies.size());
+  std::partial_sort(replies.begin(), replies.begin() + count, replies.end(),
+                    [](const std::pair<float, uint16_t>& a,
+                       const std::pair<float, uint16_t>& b) {
+                      return a.first < b.first;
+                    });
+  const BitBoard pawns = history->Last().GetBoard().pawns();
+  for (size_t i = 0; i < count; ++i) {
+    Move move = Move::FromNNIndex(replies[i].second);
+    if (move.promotion() == Move::Promotion::None && move.to().row() == 7 &&
+        pawns.get(move.from())) {
+      move = Move(move.from(), move.to(), Move::Promotion::Knight);
+    }
+    history->Append(move);
+    const auto hash = history->HashLast(kCacheHistoryLength + 1);
+    // Replies which are already in cache stay pinned in the batch, which is
+    // cheaper than looking them up separately.
+    if (!computation->AddInputByHash(hash)) {
+      AddPositionToCompute(hash, nullptr, computation, *history);
+    }
+    history->Pop();
+  }
+  return count;
+}
+
 namespace {
 // Returns a child with most visits.
 Node* GetBestChild(Node* parent) {
@@ -387,6 +745,7 @@ Node* GetBestChild(Node* parent) {
 
 Node* GetBestChildWithTemperature(Node* parent, float temperature) {
   std::vector<float> cumulative_sums;
+  cumulative_sums.reserve(parent->GetNumChildren());
   float sum = 0.0;
   const float n_parent = parent->GetN();
 
@@ -419,19 +778,36 @@ void Search::SendUciInfo() REQUIRES(nodes_mutex_) {
       cache_->GetSize() * 1000LL / std::max(cache_->GetCapacity(), 1);
   uci_info_.nps =
       uci_info_.time ? (total_playouts_ * 1000 / uci_info_.time) : 0;
+  GetSearchMetrics()->nps = uci_info_.nps;
   uci_info_.score =
       290.680623072 * tan(1.548090806 * best_move_node_->GetQ(0, 0));
   uci_info_.pv.clear();
 
   bool flip = played_history_.IsBlackToMove();
-  for (Node* iter = best_move_node_; iter;
-       iter = GetBestChild(iter), flip = !flip) {
+  for (Node* iter = best_move_node_; iter; flip = !flip) {
     uci_info_.pv.push_back(iter->GetMove(flip));
+    // Only below the visited part of the tree children have to be scanned.
+    iter = iter->GetBestChild() ? iter->GetBestChild() : GetBestChild(iter);
   }
   uci_info_.comment.clear();
   info_callback_(uci_info_);
 }
 
+void Search::MaybeReportVisits() REQUIRES(nodes_mutex_) {
+  if (!visits_callback_) return;
+  const int64_t visits = total_playouts_ + initial_visits_;
+  while (next_visits_threshold_ < visits_thresholds_.size() &&
+         visits >= visits_thresholds_[next_visits_threshold_]) {
+    Move best_move;
+    {
+      Mutex::Lock counters_lock(counters_mutex_);
+      best_move = GetBestMoveInternal().first;
+    }
+    visits_callback_(visits_thresholds_[next_visits_threshold_++], visits,
+                     best_move);
+  }
+}
+
 // Decides whether anything important changed in stats and new info should be
 // shown to a user.
 void Search::MaybeOutputInfo() {
@@ -496,6 +872,42 @@ void Search::SendMovesStats() const {
   }
 }
 
+void Search::SendBatchStats() const REQUIRES(counters_mutex_) {
+  std::ostringstream oss;
+  oss << std::fixed << std::setprecision(2);
+  oss << "Minibatches: " << minibatches_ << ", cut short by collision: "
+      << collisions_ << ", average size: "
+      << (minibatches_ ? static_cast<float>(minibatch_nodes_) / minibatches_
+                       : 0.0f)
+      << ", virtual loss: " << virtual_loss_.load();
+  ThinkingInfo info;
+  info.comment = oss.str();
+  info_callback_(info);
+}
+
+void Search::UpdateVirtualLoss(int gathered, bool collided) {
+  Mutex::Lock lock(counters_mutex_);
+  ++minibatches_;
+  minibatch_nodes_ += gathered;
+  if (collided) {
+    ++collisions_;
+    ++GetSearchMetrics()->collisions;
+  }
+  if (!kAdaptiveVirtualLoss) return;
+  // Updates are serialized by the lock, so load and store don't race.
+  float virtual_loss = virtual_loss_.load(std::memory_order_relaxed);
+  if (collided && gathered < kVirtualLossTargetFill * kMiniBatchSize) {
+    virtual_loss =
+        std::min(kMaxAdaptiveVirtualLoss,
+                 virtual_loss * kVirtualLossRaiseFactor + kVirtualLossRaiseStep);
+  } else {
+    virtual_loss =
+        std::max(kExtraVirtualLoss, virtual_loss * kVirtualLossDecayFactor);
+  }
+  virtual_loss_.store(virtual_loss, std::memory_order_relaxed);
+  GetSearchMetrics()->virtual_loss = virtual_loss;
+}
+
 void Search::MaybeTriggerStop() {
   SharedMutex::Lock nodes_lock(nodes_mutex_);
   Mutex::Lock lock(counters_mutex_);
@@ -521,7 +933,10 @@ void Search::MaybeTriggerStop() {
   // If we are the first to see that stop is needed.
   if (stop_ && !responded_bestmove_) {
     SendUciInfo();
-    if (kVerboseStats) SendMovesStats();
+    if (kVerboseStats) {
+      SendMovesStats();
+      SendBatchStats();
+    }
     best_move_ = GetBestMoveInternal();
     best_move_callback_({best_move_.first, best_move_.second});
     responded_bestmove_ = true;
@@ -534,7 +949,9 @@ void Search::UpdateRemainingMoves() {
   SharedMutex::Lock lock(nodes_mutex_);
   remaining_playouts_ = std::numeric_limits<int>::max();
   // Check for how many playouts there is time remaining.
-  if (limits_.time_ms >= 0) {
+  // Nps is not reproducible, so it's not taken into account in deterministic
+  // mode.
+  if (limits_.time_ms >= 0 && !kDeterministic) {
     auto time_since_start = GetTimeSinceStart();
     if (time_since_start > kSmartPruningToleranceMs) {
       auto nps = (1000LL * total_playouts_ + kSmartPruningToleranceNodes) /
@@ -569,6 +986,100 @@ void Search::UpdateRemainingMoves() {
   if (remaining_playouts_ <= 1) remaining_playouts_ = 1;
 }
 
+void Search::DoBackupUpdate(const std::vector<Node*>& nodes,
+                            BackupUpdates* backup) {
+  auto& updates = backup->updates;
+  updates.clear();
+  backup->index.clear();
+
+  // Merge paths of all visits into a tree of updates. Parent links don't
+  // change during the search, so that doesn't need a lock.
+  for (Node* node : nodes) {
+    const int first_new_idx = updates.size();
+    int leaf_idx = -1;
+    int child_idx = -1;
+    for (Node* n = node;; n = n->GetParent()) {
+      auto iter = backup->index.find(n);
+      const bool is_known = iter != backup->index.end();
+      int idx;
+      if (is_known) {
+        idx = iter->second;
+      } else {
+        idx = updates.size();
+        updates.push_back({n, -1, 0, 0, 0.0f, 0, false, 0});
+        backup->index.emplace(n, idx);
+      }
+      if (child_idx >= 0) updates[child_idx].parent_idx = idx;
+      if (leaf_idx < 0) leaf_idx = idx;
+      // Rest of the path is already there.
+      if (is_known || n == root_node_) break;
+      child_idx = idx;
+    }
+    // New updates were appended leaf first, so parents' depths are known when
+    // going backwards.
+    for (int idx = updates.size() - 1; idx >= first_new_idx; --idx) {
+      auto& update = updates[idx];
+      update.depth =
+          update.parent_idx < 0 ? 0 : updates[update.parent_idx].depth + 1;
+    }
+
+    auto& leaf = updates[leaf_idx];
+    ++leaf.visits;
+    leaf.v += node->GetV();
+    leaf.max_depth = 1;
+    leaf.full_depth_updated = true;
+    // If the node is terminal, mark it as fully explored to an infinite depth.
+    leaf.full_depth = node->IsTerminal() ? 999 : 0;
+  }
+
+  // Children have to be processed before parents.
+  auto& order = backup->order;
+  order.resize(updates.size());
+  for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+  std::sort(order.begin(), order.end(), [&updates](int a, int b) {
+    return updates[a].depth > updates[b].depth;
+  });
+
+  // Sum visits, values and depths bottom-up, still without a lock.
+  for (int idx : order) {
+    const auto& update = updates[idx];
+    if (update.parent_idx < 0) continue;
+    auto& parent = updates[update.parent_idx];
+    parent.visits += update.visits;
+    // Q will be flipped for opponent.
+    parent.v -= update.v;
+    parent.max_depth =
+        std::max<uint16_t>(parent.max_depth, update.max_depth + 1);
+  }
+
+  // Apply updates, every node once.
+  SharedMutex::Lock lock(nodes_mutex_);
+  for (int idx : order) {
+    auto& update = updates[idx];
+    Node* n = update.node;
+    n->FinalizeScoreUpdate(update.v, update.visits);
+    n->UpdateMaxDepth(update.max_depth);
+    // Full depth depends on children's full depth, so is propagated only
+    // while it's being updated.
+    if (update.full_depth_updated && n->UpdateFullDepth(&update.full_depth) &&
+        update.parent_idx >= 0) {
+      auto& parent = updates[update.parent_idx];
+      parent.full_depth_updated = true;
+      parent.full_depth = std::max(parent.full_depth, update.full_depth);
+    }
+  }
+  // Best move. Updates are in order of the first visit within the batch, so
+  // ties are resolved the same way as when visits are applied one by one.
+  for (const auto& update : updates) {
+    if (update.depth != 1) continue;
+    if (!best_move_node_ || best_move_node_->GetN() < update.node->GetN()) {
+      best_move_node_ = update.node;
+    }
+  }
+  total_playouts_ += nodes.size();
+  MaybeReportVisits();
+}
+
 void Search::ExtendNode(Node* node, const PositionHistory& history) {
   // Not taking mutex because other threads will see that N=0 and N-in-flight=1
   // and will not touch this node.
@@ -610,7 +1121,9 @@ void Search::ExtendNode(Node* node, const PositionHistory& history) {
   for (const auto& move : legal_moves) node->CreateChild(move);
 }
 
-Node* Search::PickNodeToExtend(Node* node, PositionHistory* history) {
+Node* Search::PickNodeToExtend(Node* node, PositionHistory* history,
+                               ChildStats* children) {
+  const float virtual_loss = virtual_loss_.load(std::memory_order_relaxed);
   // Fetch the current best root node visits for possible smart pruning.
   int best_node_n = 0;
   {
@@ -640,13 +1153,11 @@ Node* Search::PickNodeToExtend(Node* node, PositionHistory* history) {
     // Now we are not in leave, we need to go deeper.
     SharedMutex::SharedLock lock(nodes_mutex_);
     float factor = kCpuct * std::sqrt(std::max(node->GetChildrenVisits(), 1u));
-    float best = -100.0f;
     int possible_moves = 0;
-    float parent_q =
-        (is_root_node && kNoise)
-            ? -node->GetQ(0, kExtraVirtualLoss)
-            : -node->GetQ(0, kExtraVirtualLoss) -
-                  kFpuReduction * std::sqrt(node->GetVisitedPolicy());
+
+    // Gather stats of children in one pass over the list.
+    children->Reserve(node->GetNumChildren());
+    size_t num_children = 0;
     for (Node* iter : node->Children()) {
       if (is_root_node) {
         // If there's no chance to catch up the currently best node with
@@ -660,15 +1171,41 @@ Node* Search::PickNodeToExtend(Node* node, PositionHistory* history) {
         }
         ++possible_moves;
       }
-      float Q = iter->GetQ(parent_q, kExtraVirtualLoss);
-      if (kVirtualLossBug && iter->GetN() == 0) {
-        Q = (Q * iter->GetParent()->GetN() - kVirtualLossBug) /
-            (iter->GetParent()->GetN() + std::fabs(kVirtualLossBug));
-      }
-      const float score = factor * iter->GetU() + Q;
-      if (score > best) {
-        best = score;
-        node = iter;
+      children->nodes[num_children] = iter;
+      children->p[num_children] = iter->GetP();
+      children->n_started[num_children] = iter->GetNStarted();
+      children->q[num_children] = iter->GetQ(0.0f, virtual_loss);
+      children->is_visited[num_children] = iter->GetN() > 0 ? 1.0f : 0.0f;
+      ++num_children;
+    }
+
+    // All unvisited children share the same (first play urgency) Q.
+    float fpu_q = (is_root_node && kNoise)
+                      ? -node->GetQ(0, virtual_loss)
+                      : -node->GetQ(0, virtual_loss) -
+                            kFpuReduction *
+                                std::sqrt(node->GetVisitedPolicy());
+    if (kVirtualLossBug) {
+      fpu_q = (fpu_q * node->GetN() - kVirtualLossBug) /
+              (node->GetN() + std::fabs(kVirtualLossBug));
+    }
+
+    // Branch-free scoring of all children.
+    const float* p = children->p.data();
+    const float* n_started = children->n_started.data();
+    const float* q = children->q.data();
+    const float* is_visited = children->is_visited.data();
+    float* scores = children->scores.data();
+    for (size_t i = 0; i < num_children; ++i) {
+      const float u = p[i] / (1.0f + n_started[i]);
+      scores[i] = factor * u + (is_visited[i] != 0.0f ? q[i] : fpu_q);
+    }
+
+    float best = -100.0f;
+    for (size_t i = 0; i < num_children; ++i) {
+      if (scores[i] > best) {
+        best = scores[i];
+        node = children->nodes[i];
       }
     }
     history->Append(node->GetMove());
@@ -682,6 +1219,133 @@ Node* Search::PickNodeToExtend(Node* node, PositionHistory* history) {
   }
 }
 
+int Search::PickNodesToExtend(Node* node, int visits, bool is_root_node,
+                              ChildStats* children,
+                              std::vector<Node*>* leaves) {
+  if (visits <= 0) return 0;
+  // The node is currently being expanded by another thread or by this batch.
+  if (!node->TryStartScoreUpdate()) return 0;
+
+  if (!node->HasChildren()) {
+    // Terminal node can take all visits, as it doesn't need evaluation.
+    if (node->IsTerminal()) {
+      node->IncrementNInFlight(visits - 1);
+      leaves->insert(leaves->end(), visits, node);
+      return visits;
+    }
+    // Other leaves are expanded by the first visit.
+    leaves->push_back(node);
+    return 1;
+  }
+
+  const float factor =
+      kCpuct * std::sqrt(std::max(node->GetChildrenVisits(), 1u));
+  const float virtual_loss = virtual_loss_.load(std::memory_order_relaxed);
+  // All unvisited children share the same (first play urgency) Q.
+  float fpu_q = (is_root_node && kNoise)
+                    ? -node->GetQ(0, virtual_loss)
+                    : -node->GetQ(0, virtual_loss) -
+                          kFpuReduction * std::sqrt(node->GetVisitedPolicy());
+  if (kVirtualLossBug) {
+    fpu_q = (fpu_q * node->GetN() - kVirtualLossBug) /
+            (node->GetN() + std::fabs(kVirtualLossBug));
+  }
+  auto get_q = [&](const Node* child) {
+    return child->GetN() > 0 ? child->GetQ(0.0f, virtual_loss) : fpu_q;
+  };
+  auto get_score = [&](const Node* child) {
+    return factor * child->GetU() + get_q(child);
+  };
+
+  // Scores of all levels of recursion share one buffer, this level uses
+  // [begin, end). Children which can't take more visits get -inf.
+  auto& scores = children->multivisit_scores;
+  const size_t begin = scores.size();
+  int best_node_n = 0;
+  if (is_root_node && best_move_node_) {
+    best_node_n = best_move_node_->GetNStarted();
+  }
+  int possible_moves = 0;
+  for (Node* iter : node->Children()) {
+    if (is_root_node) {
+      // If there's no chance to catch up the currently best node with
+      // remaining playouts, not consider it.
+      if (iter != best_move_node_ &&
+          remaining_playouts_ < best_node_n - iter->GetNStarted()) {
+        continue;
+      }
+      ++possible_moves;
+    }
+    scores.emplace_back(get_score(iter), iter);
+  }
+  const size_t end = scores.size();
+  if (is_root_node && possible_moves <= 1 && !limits_.infinite) {
+    // If there is only one move theoretically possible within remaining time,
+    // output it.
+    Mutex::Lock counters_lock(counters_mutex_);
+    found_best_move_ = true;
+  }
+
+  const float kExhausted = -std::numeric_limits<float>::infinity();
+  int visits_used = 0;
+  while (visits_used < visits) {
+    // Find the best child and the score of the runner-up.
+    size_t best_idx = end;
+    float best = -100.0f;
+    float second_best = kExhausted;
+    for (size_t i = begin; i < end; ++i) {
+      const float score = scores[i].first;
+      if (score > best) {
+        if (best_idx != end) second_best = best;
+        best = score;
+        best_idx = i;
+      } else if (score > second_best) {
+        second_best = score;
+      }
+    }
+    if (best_idx == end) break;
+
+    // Send the best child as many visits as it takes for its U to drop below
+    // the runner-up.
+    Node* child = scores[best_idx].second;
+    int budget = visits - visits_used;
+    const float q = get_q(child);
+    if (second_best > q) {
+      budget = std::min(budget, int(child->GetP() * factor / (second_best - q) -
+                                    child->GetNStarted()) +
+                                    1);
+      budget = std::max(budget, 1);
+    }
+    const int used =
+        PickNodesToExtend(child, budget, false, children, leaves);
+    visits_used += used;
+    // If the child couldn't take all visits, its subtree has nothing more to
+    // visit in this batch.
+    scores[best_idx].first = used < budget ? kExhausted : get_score(child);
+  }
+  scores.resize(begin);
+
+  if (visits_used == 0) {
+    node->CancelScoreUpdate();
+  } else {
+    node->IncrementNInFlight(visits_used - 1);
+  }
+  return visits_used;
+}
+
+void Search::SetHistoryToNode(Node* node, PositionHistory* history,
+                              ChildStats* children) const {
+  auto& path = children->path;
+  path.clear();
+  for (Node* n = node; n != root_node_; n = n->GetParent()) {
+    path.push_back(n->GetMove());
+  }
+  history->Trim(played_history_.GetLength());
+  for (auto iter = path.rbegin(); iter != path.rend(); ++iter) {
+    history->Append(*iter);
+  }
+}
+
 std::pair<Move, Move> Search::GetBestMove() const {
   SharedMutex::SharedLock lock(nodes_mutex_);
   Mutex::Lock counters_lock(counters_mutex_);
@@ -710,24 +1374,39 @@ std::pair<Move, Move> Search::GetBestMoveInternal() const
 
   Move ponder_move;
   if (best_node->HasChildren()) {
-    ponder_move =
-        GetBestChild(best_node)->GetMove(!played_history_.IsBlackToMove());
+    const Node* ponder_node = best_node->GetBestChild()
+                                  ? best_node->GetBestChild()
+                                  : GetBestChild(best_node);
+    ponder_move = ponder_node->GetMove(!played_history_.IsBlackToMove());
   }
   return {best_node->GetMove(played_history_.IsBlackToMove()), ponder_move};
 }
 
+void Search::SetVisitsCallback(std::vector<int64_t> thresholds,
+                               VisitsCallback callback) {
+  std::sort(thresholds.begin(), thresholds.end());
+  visits_thresholds_ = std::move(thresholds);
+  visits_callback_ = callback;
+}
+
 void Search::StartThreads(size_t how_many) {
   Mutex::Lock lock(threads_mutex_);
+  // Order of tree updates from several threads is not reproducible.
+  if (kDeterministic) how_many = 1;
   while (threads_.size() < how_many) {
-    threads_.emplace_back([&]() { Worker(); });
+    const int thread_idx = threads_.size();
+    threads_.emplace_back([this, thread_idx]() {
+      BindThreadToNumaNode(thread_idx);
+      Worker(thread_idx);
+    });
   }
 }
 
-void Search::RunSingleThreaded() { Worker(); }
+void Search::RunSingleThreaded() { Worker(0); }
 
 void Search::RunBlocking(size_t threads) {
-  if (threads == 1) {
-    Worker();
+  if (threads == 1 || kDeterministic) {
+    Worker(0);
   } else {
     StartThreads(threads);
     Wait();
@@ -18,11 +18,13 @@
 
 #pragma once
 
+#include <atomic>
 #include <functional>
 #include <shared_mutex>
 #include <thread>
 #include "chess/callbacks.h"
 #include "chess/uciloop.h"
+#include "mcts/evalqueue.h"
 #include "mcts/node.h"
 #include "neural/cache.h"
 #include "neural/network.h"
@@ -71,6 +73,18 @@ class Search {
   // Returns best move, from the point of view of white player. And also ponder.
   std::pair<Move, Move> GetBestMove() const;
 
+  // Is called when number of root visits reaches a requested @threshold.
+  // Visits are added a minibatch at a time, so actual number of @visits (which
+  // node stats and @best_move correspond to) may be larger.
+  // The tree is locked during the call, so it's safe to read node stats, but
+  // the callback must not call other Search methods.
+  using VisitsCallback =
+      std::function<void(int64_t threshold, int64_t visits, Move best_move)>;
+  // Requests @callback to be called every time when number of root visits
+  // crosses one of @thresholds. Must be called before search is started.
+  void SetVisitsCallback(std::vector<int64_t> thresholds,
+                         VisitsCallback callback);
+
   // Strings for UCI params. So that others can override defaults.
   static const char* kMiniBatchSizeStr;
   static const char* kMiniPrefetchBatchStr;
@@ -85,10 +99,21 @@ class Search {
   static const char* kCacheHistoryLengthStr;
   static const char* kExtraVirtualLossStr;
   static const char* KPolicySoftmaxTempStr;
+  static const char* kDeterministicStr;
+  static const char* kMultiVisitDescentStr;
+  static const char* kOutOfOrderEvalStr;
+  static const char* kConcurrentBatchesStr;
+  static const char* kAdaptiveVirtualLossStr;
 
  private:
-  // Can run several copies of it in separate threads.
-  void Worker();
+  // Can run several copies of it in separate threads, @thread_idx tells them
+  // apart.
+  void Worker(int thread_idx);
+  // Worker for out-of-order evaluation mode. Submits leaves to eval_queue_
+  // one by one and backs up whichever are evaluated, in any order. A leaf in
+  // the queue is a suspended visit, so a single thread keeps many visits in
+  // flight without blocking on NN.
+  void AsyncWorker();
 
   std::pair<Move, Move> GetBestMoveInternal() const;
   int64_t GetTimeSinceStart() const;
@@ -96,16 +121,54 @@ class Search {
   void MaybeTriggerStop();
   void MaybeOutputInfo();
   void SendMovesStats() const;
+  // Sends collision and minibatch stats. Requires counters_mutex_ to be held.
+  void SendBatchStats() const;
+  // Accounts a minibatch of @gathered nodes, where gathering was cut short
+  // by a collision if @collided, and adjusts adaptive virtual loss.
+  void UpdateVirtualLoss(int gathered, bool collided);
+  // Per-worker buffers for child selection and backup, defined in search.cc.
+  struct ChildStats;
+  struct BackupUpdates;
+
   bool AddNodeToCompute(Node* node, CachingComputation* computation,
-                        const PositionHistory& history,
-                        bool add_if_cached = true);
+                        const PositionHistory& history);
+  // Adds position which is known not to be in cache. @node may be nullptr if
+  // the position is not in the tree.
+  void AddPositionToCompute(uint64_t hash, const Node* node,
+                            CachingComputation* computation,
+                            const PositionHistory& history);
   int PrefetchIntoCache(Node* node, int budget, CachingComputation* computation,
-                        PositionHistory* history);
+                        PositionHistory* history, ChildStats* scratch);
+  int PrefetchCachedReplies(const CachedNNRequest& request, int budget,
+                            CachingComputation* computation,
+                            PositionHistory* history, ChildStats* scratch);
 
   void SendUciInfo();  // Requires nodes_mutex_ to be held.
+  void MaybeReportVisits();  // Requires nodes_mutex_ to be held.
 
-  Node* PickNodeToExtend(Node* node, PositionHistory* history);
+  Node* PickNodeToExtend(Node* node, PositionHistory* history,
+                         ChildStats* children);
+  // Sends up to @visits visits from @node down the tree in a single
+  // traversal, and appends leaves they reach to @leaves. Returns number of
+  // visits which reached a leaf. Requires nodes_mutex_ to be held exclusively.
+  int PickNodesToExtend(Node* node, int visits, bool is_root_node,
+                        ChildStats* children, std::vector<Node*>* leaves);
+  // Resets @history to the position of @node.
+  void SetHistoryToNode(Node* node, PositionHistory* history,
+                        ChildStats* children) const;
   void ExtendNode(Node* node, const PositionHistory& history);
+  // Sets V of an evaluated @node and P of its children. @get_p(idx, move)
+  // returns raw prior of idx-th child, which has NN move index @move.
+  template <typename GetP>
+  void SetEvaluation(Node* node, float q, GetP get_p);
+  // Sets evaluation of @node from @sample of @computation. @moves and
+  // @priors are scratch buffers.
+  void SetEvaluation(Node* node, const CachingComputation& computation,
+                     int sample, std::vector<uint16_t>* moves,
+                     std::vector<float>* priors);
+  // Updates stats of @nodes and all their ancestors with the results of a
+  // minibatch.
+  void DoBackupUpdate(const std::vector<Node*>& nodes, BackupUpdates* updates);
 
   mutable Mutex counters_mutex_ ACQUIRED_AFTER(nodes_mutex_);
   // Tells all threads to stop.
@@ -118,6 +181,13 @@ class Search {
   // Stored so that in the case of non-zero temperature GetBestMove() returns
   // consistent results.
   std::pair<Move, Move> best_move_ GUARDED_BY(counters_mutex_);
+  // Minibatch stats.
+  int64_t minibatches_ GUARDED_BY(counters_mutex_) = 0;
+  int64_t minibatch_nodes_ GUARDED_BY(counters_mutex_) = 0;
+  int64_t collisions_ GUARDED_BY(counters_mutex_) = 0;
+  // Virtual loss used in selection. Constant unless it's adaptive. Read
+  // without a lock on every descent, so it's atomic.
+  std::atomic<float> virtual_loss_;
 
   Mutex threads_mutex_;
   std::vector<std::thread> threads_ GUARDED_BY(threads_mutex_);
@@ -131,6 +201,10 @@ class Search {
   const SearchLimits limits_;
   const std::chrono::steady_clock::time_point start_time_;
   const int64_t initial_visits_;
+  // Drawn from the generator of the thread which creates the search, so that
+  // random numbers of workers are reproducible when it is (e.g. in selfplay
+  // games), regardless of which threads run them.
+  const uint64_t search_id_;
 
   mutable SharedMutex nodes_mutex_;
   Node* best_move_node_ GUARDED_BY(nodes_mutex_) = nullptr;
@@ -143,6 +217,11 @@ class Search {
   BestMoveInfo::Callback best_move_callback_;
   ThinkingInfo::Callback info_callback_;
 
+  // Sorted root visits thresholds to call visits_callback_ at.
+  std::vector<int64_t> visits_thresholds_;
+  size_t next_visits_threshold_ GUARDED_BY(nodes_mutex_) = 0;
+  VisitsCallback visits_callback_;
+
   // External parameters.
   const int kMiniBatchSize;
   const int kMiniPrefetchBatch;
@@ -157,6 +236,23 @@ class Search {
   const bool kCacheHistoryLength;
   const float kExtraVirtualLoss;
   const float KPolicySoftmaxTemp;
+  // Single search thread, fixed random seed, and batches which don't depend
+  // on cache contents or timing, so that the tree is reproducible.
+  const bool kDeterministic;
+  // Gather the whole minibatch in one tree traversal instead of descending
+  // from the root for every leaf.
+  const bool kMultiVisitDescent;
+  // Leaves are evaluated through a queue shared by all threads, rather than
+  // in per-thread minibatches.
+  const bool kOutOfOrderEval;
+  // Number of minibatches which may be evaluated at once in out-of-order
+  // mode.
+  const int kConcurrentBatches;
+  // Raise virtual loss when collisions prevent filling minibatches, and
+  // decay it back to kExtraVirtualLoss otherwise.
+  const bool kAdaptiveVirtualLoss;
+
+  std::unique_ptr<EvalQueue> eval_queue_;
 };
 
 }  // namespace lczero
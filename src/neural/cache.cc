@@ -20,6 +20,26 @@
 #include <iostream>
 
 namespace lczero {
+std::vector<Metrics::Registration> RegisterCacheMetrics(
+    const NNCache* cache, const std::string& labels) {
+  auto* metrics = Metrics::Get();
+  std::vector<Metrics::Registration> result;
+  result.push_back(metrics->AddGauge(
+      "lc0_nncache_size", "Number of positions in NN cache.",
+      [cache]() { return cache->GetSize(); }, labels));
+  result.push_back(metrics->AddGauge(
+      "lc0_nncache_capacity", "Maximum number of positions in NN cache.",
+      [cache]() { return cache->GetCapacity(); }, labels));
+  result.push_back(metrics->AddCounter(
+      "lc0_nncache_hits_total", "NN cache lookups which found the position.",
+      [cache]() { return cache->GetHits(); }, labels));
+  result.push_back(metrics->AddCounter(
+      "lc0_nncache_misses_total",
+      "NN cache lookups which didn't find the position.",
+      [cache]() { return cache->GetMisses(); }, labels));
+  return result;
+}
+
 CachingComputation::CachingComputation(
     std::unique_ptr<NetworkComputation> parent, NNCache* cache)
     : parent_(std::move(parent)), cache_(cache) {}
@@ -43,6 +63,12 @@ void CachingComputation::AddInput(
     uint64_t hash, InputPlanes&& input,
     std::vector<uint16_t>&& probabilities_to_cache) {
   if (AddInputByHash(hash)) return;
+  AddUncachedInput(hash, std::move(input), std::move(probabilities_to_cache));
+}
+
+void CachingComputation::AddUncachedInput(
+    uint64_t hash, InputPlanes&& input,
+    std::vector<uint16_t>&& probabilities_to_cache) {
   batch_.emplace_back();
   batch_.back().hash = hash;
   batch_.back().idx_in_parent = parent_->GetBatchSize();
@@ -65,11 +91,13 @@ void CachingComputation::ComputeBlocking() {
     if (item.idx_in_parent == -1) continue;
     auto req =
         std::make_unique<CachedNNRequest>(item.probabilities_to_cache.size());
-    req->q = parent_->GetQVal(item.idx_in_parent);
+    priors_.resize(item.probabilities_to_cache.size());
+    req->q = parent_->GetQAndPVals(item.idx_in_parent,
+                                   item.probabilities_to_cache, priors_.data());
     int idx = 0;
     for (auto x : item.probabilities_to_cache) {
-      req->p[idx++] =
-          std::make_pair(x, parent_->GetPVal(item.idx_in_parent, x));
+      req->p[idx] = std::make_pair(x, priors_[idx]);
+      ++idx;
     }
     cache_->Insert(item.hash, std::move(req));
   }
@@ -99,4 +127,23 @@ float CachingComputation::GetPVal(int sample, int move_id) const {
   return 0;
 }
 
+float CachingComputation::GetQAndPVals(int sample,
+                                       const std::vector<uint16_t>& move_ids,
+                                       float* p) const {
+  const auto& item = batch_[sample];
+  if (item.idx_in_parent >= 0) {
+    return parent_->GetQAndPVals(item.idx_in_parent, move_ids, p);
+  }
+  const auto& moves = item.lock->p;
+  for (int i = 0; i < static_cast<int>(move_ids.size()); ++i) {
+    // Usually moves are stored in the same order as queried.
+    if (i < moves.size() && moves[i].first == move_ids[i]) {
+      p[i] = moves[i].second;
+    } else {
+      p[i] = GetPVal(sample, move_ids[i]);
+    }
+  }
+  return item.lock->q;
+}
+
 }  // namespace lczero
@@ -19,6 +19,7 @@
 
 #include "neural/network.h"
 #include "utils/cache.h"
+#include "utils/metrics.h"
 #include "utils/smallarray.h"
 
 namespace lczero {
@@ -34,6 +35,11 @@ struct CachedNNRequest {
 typedef LruCache<uint64_t, CachedNNRequest> NNCache;
 typedef LruCacheLock<uint64_t, CachedNNRequest> NNCacheLock;
 
+// Exports size, capacity and hit/miss counts of @cache while returned
+// registrations are alive. @labels distinguish several caches in one process.
+std::vector<Metrics::Registration> RegisterCacheMetrics(
+    const NNCache* cache, const std::string& labels = "");
+
 // Wraps around NetworkComputation and caches result.
 // While it mostly repeats NetworkComputation interface, it's not derived
 // from it, as AddInput() needs hash and index of probabilities to store.
@@ -55,6 +61,10 @@ class CachingComputation {
   // @probabilities_to_cache is which indices of policy head to store.
   void AddInput(uint64_t hash, InputPlanes&& input,
                 std::vector<uint16_t>&& probabilities_to_cache);
+  // Same as AddInput(), for a @hash which AddInputByHash() just didn't find,
+  // so that cache is not looked up again.
+  void AddUncachedInput(uint64_t hash, InputPlanes&& input,
+                        std::vector<uint16_t>&& probabilities_to_cache);
   // Undos last AddInput. If it was a cache miss, the it's actually not removed
   // from parent's batch.
   void PopLastInputHit();
@@ -64,6 +74,11 @@ class CachingComputation {
   float GetQVal(int sample) const;
   // Returns P value @move_id of @sample.
   float GetPVal(int sample, int move_id) const;
+  // Writes P values of @move_ids of @sample into @p, which must have room for
+  // all of them, and returns Q value. Fastest when @move_ids are in the order
+  // they were cached in.
+  float GetQAndPVals(int sample, const std::vector<uint16_t>& move_ids,
+                     float* p) const;
 
  private:
   struct WorkItem {
@@ -77,6 +92,8 @@ class CachingComputation {
   std::unique_ptr<NetworkComputation> parent_;
   NNCache* cache_;
   std::vector<WorkItem> batch_;
+  // Scratch buffer for P values to store in cache.
+  std::vector<float> priors_;
 };
 
 }  // namespace lczero
\ No newline at end of file
@@ -0,0 +1,65 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2018 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "neural/latency.h"
+
+#include <chrono>
+#include <thread>
+
+namespace lczero {
+
+namespace {
+// Returns option @key in milliseconds, which may be given as integer or float.
+float GetMilliseconds(const OptionsDict& options, const std::string& key) {
+  if (options.Exists<int>(key)) return options.Get<int>(key);
+  return options.GetOrDefault<float>(key, 0.0f);
+}
+}  // namespace
+
+LatencyModel::LatencyModel(const OptionsDict& options)
+    : delay_ms_(GetMilliseconds(options, "delay")),
+      sample_delay_ms_(GetMilliseconds(options, "sample_delay")),
+      jitter_ms_(GetMilliseconds(options, "jitter")),
+      slots_(options.GetOrDefault<int>("slots", 0)) {}
+
+void LatencyModel::Compute(int batch_size) {
+  float ms = delay_ms_ + sample_delay_ms_ * batch_size;
+  {
+    std::unique_lock<std::mutex> lock(mutex_.get_raw());
+    if (jitter_ms_ > 0.0f) {
+      ms += std::uniform_real_distribution<float>(0.0f, jitter_ms_)(gen_);
+    }
+    if (slots_ > 0) {
+      cv_.wait(lock, [this]() { return busy_slots_ < slots_; });
+      ++busy_slots_;
+    }
+  }
+  if (ms > 0.0f) {
+    std::this_thread::sleep_for(std::chrono::duration<float, std::milli>(ms));
+  }
+  if (slots_ > 0) {
+    {
+      Mutex::Lock lock(mutex_);
+      --busy_slots_;
+    }
+    cv_.notify_one();
+  }
+}
+
+}  // namespace lczero
@@ -0,0 +1,60 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2018 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#pragma once
+
+#include <condition_variable>
+#include <random>
+#include "utils/mutex.h"
+#include "utils/optionsdict.h"
+
+namespace lczero {
+
+// Simulates latency of a batched accelerator: computing a batch takes fixed
+// overhead plus time per sample plus random jitter, and only a limited number
+// of batches are computed at once, others wait for a free slot.
+//
+// Options, all in milliseconds except slots:
+// delay: fixed time of every batch.
+// sample_delay: additional time per sample.
+// jitter: maximum random addition to time of a batch.
+// slots: how many batches may be computed at once, 0 for unlimited.
+class LatencyModel {
+ public:
+  LatencyModel(const OptionsDict& options);
+
+  // Blocks for as long as computing a batch of @batch_size takes.
+  void Compute(int batch_size);
+
+ private:
+  const float delay_ms_;
+  const float sample_delay_ms_;
+  const float jitter_ms_;
+  // Maximum number of batches computed at once, 0 for unlimited.
+  const int slots_;
+
+  Mutex mutex_;
+  std::condition_variable cv_;
+  int busy_slots_ GUARDED_BY(mutex_) = 0;
+  // Random::Get() is not used, so that jitter doesn't change random numbers
+  // which search thread gets.
+  std::mt19937 gen_ GUARDED_BY(mutex_);
+};
+
+}  // namespace lczero
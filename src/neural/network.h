@@ -86,6 +86,16 @@ class NetworkComputation {
   virtual float GetQVal(int sample) const = 0;
   // Returns P value @move_id of @sample.
   virtual float GetPVal(int sample, int move_id) const = 0;
+  // Writes P values of @move_ids of @sample into @p, which must have room for
+  // all of them, and returns Q value. Backends override it to avoid a virtual
+  // call per move.
+  virtual float GetQAndPVals(int sample, const std::vector<uint16_t>& move_ids,
+                             float* p) const {
+    for (size_t i = 0; i < move_ids.size(); ++i) {
+      p[i] = GetPVal(sample, move_ids[i]);
+    }
+    return GetQVal(sample);
+  }
   virtual ~NetworkComputation() {}
 };
 
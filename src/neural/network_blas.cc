@@ -29,6 +29,7 @@
 
 #include "utils/blas.h"
 #include "utils/exception.h"
+#include "utils/numa.h"
 
 namespace lczero {
 
@@ -36,10 +37,14 @@ namespace {
 
 class BlasNetwork;
 
+// Tower convolutions and batchnorms use kernels specialized for kFilters
+// filters, or generic ones if it's 0.
+template <int kFilters>
 class BlasComputation : public NetworkComputation {
  public:
-  BlasComputation(const Weights& weights)
+  BlasComputation(const Weights& weights, bool winograd4x4)
       : weights_(weights),
+        winograd4x4_(winograd4x4),
         input_data_(kInputPlanes * 64),
         value_data_(weights_.ip1_val_b.size()),
         policy_data_(),
@@ -82,7 +87,6 @@ class BlasComputation : public NetworkComputation {
     // Input convolution
     constexpr int width = 8;
     constexpr int height = 8;
-    constexpr int tiles = width * height / 4;
 
     /*
      static constexpr int NUM_VALUE_INPUT_PLANES = 32;
@@ -96,9 +100,6 @@ class BlasComputation : public NetworkComputation {
     int NUM_OUTPUT_POLICY = weights_.ip_pol_b.size();
     int NUM_VALUE_CHANNELS = weights_.ip1_val_b.size();
 
-    static constexpr auto kWinogradAlpha = 4;
-    static constexpr auto kWinogradTile = kWinogradAlpha * kWinogradAlpha;
-
     // Calculate output channels
     const auto output_channels = weights_.input.biases.size();
     // input_channels is the maximum number of input channels of any
@@ -109,17 +110,31 @@ class BlasComputation : public NetworkComputation {
                                          static_cast<size_t>(kInputPlanes));
     auto conv_out = std::vector<float>(output_channels * width * height);
 
-    auto V = std::vector<float>(kWinogradTile * input_channels * tiles);
-    auto M = std::vector<float>(kWinogradTile * output_channels * tiles);
+    // Transformed tiles of all 3x3 convolution inputs and outputs take
+    // (alpha * alpha) * channels * tiles floats.
+    const auto transformed_size =
+        winograd4x4_
+            ? Transforms::kWinograd4x4Tile * Transforms::kWinograd4x4Tiles
+            : Transforms::kWinogradTile * (width * height / 4);
+    auto V = std::vector<float>(transformed_size * input_channels);
+    auto M = std::vector<float>(transformed_size * output_channels);
+    auto convolve3 = [&](int outputs, const std::vector<float>& in,
+                         const std::vector<float>& U,
+                         std::vector<float>& out) {
+      if (winograd4x4_) {
+        Transforms::WinogradConvolve3F4x4<kFilters>(outputs, in, U, V, M, out);
+      } else {
+        Transforms::WinogradConvolve3<kFilters>(outputs, in, U, V, M, out);
+      }
+    };
 
     std::vector<float> policy_data(NUM_POLICY_INPUT_PLANES * width * height);
     std::vector<float> value_data(NUM_VALUE_INPUT_PLANES * width * height);
 
-    Transforms::WinogradConvolve3(output_channels, input,
-                                   weights_.input.weights, V, M, conv_out);
-    Transforms::Batchnorm<64>(output_channels, conv_out,
-                              weights_.input.bn_means.data(),
-                              weights_.input.bn_stddivs.data());
+    convolve3(output_channels, input, weights_.input.weights, conv_out);
+    Transforms::Batchnorm<64, kFilters>(output_channels, conv_out,
+                                        weights_.input.bn_means.data(),
+                                        weights_.input.bn_stddivs.data());
 
     // Residual tower
     auto conv_in = std::vector<float>(output_channels * width * height);
@@ -131,36 +146,31 @@ class BlasComputation : public NetworkComputation {
       std::swap(conv_out, conv_in);
       std::copy(begin(conv_in), end(conv_in), begin(res));
 
-      Transforms::WinogradConvolve3(output_channels, conv_in, conv1.weights, V,
-                                     M, conv_out);
-      Transforms::Batchnorm<64>(output_channels, conv_out,
-                                conv1.bn_means.data(), conv1.bn_stddivs.data());
+      convolve3(output_channels, conv_in, conv1.weights, conv_out);
+      Transforms::Batchnorm<64, kFilters>(output_channels, conv_out,
+                                          conv1.bn_means.data(),
+                                          conv1.bn_stddivs.data());
 
       auto& conv2 = residual.conv2;
       output_channels = conv2.biases.size();
       std::swap(conv_out, conv_in);
-      Transforms::WinogradConvolve3(output_channels, conv_in, conv2.weights, V,
-                                     M, conv_out);
-      Transforms::Batchnorm<64>(output_channels, conv_out,
-                                conv2.bn_means.data(), conv2.bn_stddivs.data(),
-                                res.data());
+      convolve3(output_channels, conv_in, conv2.weights, conv_out);
+      Transforms::Batchnorm<64, kFilters>(
+          output_channels, conv_out, conv2.bn_means.data(),
+          conv2.bn_stddivs.data(), res.data());
     }
 
-    Transforms::Convolve<1>(NUM_POLICY_INPUT_PLANES, conv_out,
-                            weights_.policy.weights, weights_.policy.biases,
-                            policy_data);
-
-    Transforms::Convolve<1>(NUM_VALUE_INPUT_PLANES, conv_out,
-                            weights_.value.weights, weights_.value.biases,
-                            value_data);
-
-    Transforms::Batchnorm<width * height>(NUM_POLICY_INPUT_PLANES, policy_data,
-                                          weights_.policy.bn_means.data(),
-                                          weights_.policy.bn_stddivs.data());
+    Transforms::Convolve1x1Batchnorm(NUM_POLICY_INPUT_PLANES, conv_out,
+                                     weights_.policy.weights,
+                                     weights_.policy.bn_means.data(),
+                                     weights_.policy.bn_stddivs.data(),
+                                     policy_data);
 
-    Transforms::Batchnorm<width * height>(NUM_VALUE_INPUT_PLANES, value_data,
-                                          weights_.value.bn_means.data(),
-                                          weights_.value.bn_stddivs.data());
+    Transforms::Convolve1x1Batchnorm(NUM_VALUE_INPUT_PLANES, conv_out,
+                                     weights_.value.weights,
+                                     weights_.value.bn_means.data(),
+                                     weights_.value.bn_stddivs.data(),
+                                     value_data);
 
     // NUM_POLICY_INPUT_PLANES*width*height x NUM_OUTPUT_POLICY
     Transforms::Innerproduct(policy_data, weights_.ip_pol_w, weights_.ip_pol_b,
@@ -182,8 +192,17 @@ class BlasComputation : public NetworkComputation {
     return policy_data_[sample][move_id];
   }
 
+  float GetQAndPVals(int sample, const std::vector<uint16_t>& move_ids,
+                     float* p) const override {
+    const auto& policy = policy_data_[sample];
+    for (auto move_id : move_ids) *p++ = policy[move_id];
+    return q_value_[sample];
+  }
+
  private:
   const Weights& weights_;
+  // Use F(4x4, 3x3) Winograd transform instead of F(2x2, 3x3).
+  const bool winograd4x4_;
 
   std::vector<InputPlanes> planes_;
   std::vector<float> input_data_;
@@ -197,14 +216,43 @@ class BlasNetwork : public Network {
  public:
   virtual ~BlasNetwork(){};
 
-  BlasNetwork(const Weights& weights, const OptionsDict& /* options */)
+  BlasNetwork(const Weights& weights, const OptionsDict& options)
       : weights_(weights) {
     const int inputChannels = kInputPlanes;
     const int channels = weights.input.biases.size();
     const size_t residual_blocks = weights.residual.size();
 
-    weights_.input.weights = Transforms::WinogradTransformF(
-        weights_.input.weights, channels, inputChannels);
+    // Output tile size of Winograd convolution: 2 for F(2x2, 3x3), or 4 for
+    // F(4x4, 3x3), which needs 2.25x fewer multiplications but is a bit less
+    // accurate.
+    const int winograd = options.GetOrDefault<int>("winograd", 2);
+    if (winograd != 2 && winograd != 4) {
+      throw Exception("Unsupported Winograd tile size " +
+                      std::to_string(winograd) + ", must be 2 or 4.");
+    }
+    winograd4x4_ = winograd == 4;
+    const auto transform_f = winograd4x4_ ? Transforms::WinogradTransformF4x4
+                                          : Transforms::WinogradTransformF;
+
+    switch (channels) {
+      case 64:
+        new_computation_ = &NewComputationFor<64>;
+        break;
+      case 128:
+        new_computation_ = &NewComputationFor<128>;
+        break;
+      case 192:
+        new_computation_ = &NewComputationFor<192>;
+        break;
+      case 256:
+        new_computation_ = &NewComputationFor<256>;
+        break;
+      default:
+        new_computation_ = &NewComputationFor<0>;
+    }
+
+    weights_.input.weights =
+        transform_f(weights_.input.weights, channels, inputChannels);
 
     std::vector<float>& input_batchnorm_means = weights_.input.bn_means;
     Transforms::OffsetBatchNormMeans(input_batchnorm_means,
@@ -219,10 +267,8 @@ class BlasNetwork : public Network {
       auto& conv1 = residual.conv1;
       auto& conv2 = residual.conv2;
 
-      conv1.weights =
-          Transforms::WinogradTransformF(conv1.weights, channels, channels);
-      conv2.weights =
-          Transforms::WinogradTransformF(conv2.weights, channels, channels);
+      conv1.weights = transform_f(conv1.weights, channels, channels);
+      conv2.weights = transform_f(conv2.weights, channels, channels);
 
       std::vector<float>& batchnorm_means_1 = conv1.bn_means;
       Transforms::OffsetBatchNormMeans(batchnorm_means_1, conv1.biases);
@@ -249,6 +295,17 @@ class BlasNetwork : public Network {
     std::vector<float>& bn_val_stddivs = weights_.value.bn_stddivs;
     Transforms::InvertBatchNormStddev(bn_val_stddivs);
 
+    // Weights are read for every sample, so with threads pinned to NUMA
+    // nodes every node gets a copy in its local memory. Copies are made by
+    // threads pinned to the node.
+    const int numa_nodes = GetNumaNodeCount();
+    for (int node = 0; numa_nodes > 1 && node < numa_nodes; ++node) {
+      std::thread([this, node]() {
+        BindThreadToNumaNode(node);
+        replicas_.emplace_back(std::make_unique<Weights>(weights_));
+      }).join();
+    }
+
 #ifdef USE_OPENBLAS
 // openblas_set_num_threads(1);
 // printf("BLAS Core: %s\n", openblas_get_corename());
@@ -264,11 +321,29 @@ class BlasNetwork : public Network {
   }
 
   std::unique_ptr<NetworkComputation> NewComputation() override {
-    return std::make_unique<BlasComputation>(weights_);
+    // Computations are created on the thread which computes them.
+    const Weights& weights = replicas_.empty()
+                                 ? weights_
+                                 : *replicas_[GetThreadNumaNode() %
+                                              replicas_.size()];
+    return new_computation_(weights, winograd4x4_);
   }
 
  private:
+  template <int kFilters>
+  static std::unique_ptr<NetworkComputation> NewComputationFor(
+      const Weights& weights, bool winograd4x4) {
+    return std::make_unique<BlasComputation<kFilters>>(weights, winograd4x4);
+  }
+
   Weights weights_;
+  // Copies of weights_ in memory of every NUMA node, indexed by node. Empty
+  // if threads are not pinned.
+  std::vector<std::unique_ptr<Weights>> replicas_;
+  bool winograd4x4_;
+  // Creates computation with kernels for the number of filters of the net.
+  std::unique_ptr<NetworkComputation> (*new_computation_)(const Weights&,
+                                                          bool);
 };
 
 }  // namespace
@@ -18,18 +18,22 @@
 
 #include "neural/network.h"
 #include "neural/factory.h"
-#include "neural/transforms.h"
 
 #include <algorithm>
+#include <array>
+#include <atomic>
 #include <cassert>
+#include <chrono>
 #include <cmath>
 #include <condition_variable>
+#include <deque>
 #include <iostream>
 #include <memory>
+#include <sstream>
 #include <thread>
 
 #include "utils/exception.h"
-#include "utils/random.h"
+#include "utils/mutex.h"
 
 namespace lczero {
 
@@ -37,129 +41,314 @@ namespace {
 
 static constexpr int NUM_OUTPUT_POLICY = 1858;
 
+// Outputs of a computation, copied so that they outlive it.
+struct Outputs {
+  explicit Outputs(const NetworkComputation& computation) {
+    static const std::vector<uint16_t> kAllMoves = []() {
+      std::vector<uint16_t> moves(NUM_OUTPUT_POLICY);
+      for (int i = 0; i < NUM_OUTPUT_POLICY; i++) moves[i] = i;
+      return moves;
+    }();
+    const int size = computation.GetBatchSize();
+    q.resize(size);
+    p.resize(size * NUM_OUTPUT_POLICY);
+    for (int i = 0; i < size; i++) {
+      q[i] = computation.GetQAndPVals(i, kAllMoves, &p[i * NUM_OUTPUT_POLICY]);
+    }
+  }
+
+  int GetBatchSize() const { return q.size(); }
+
+  std::vector<float> q;
+  // NUM_OUTPUT_POLICY values per sample.
+  std::vector<float> p;
+};
+
+// Distribution of absolute errors.
+class ErrorStats {
+ public:
+  // Bucket i counts errors below 10^(i-7), except the last one which counts
+  // all the rest.
+  static constexpr int kBuckets = 8;
+
+  void Add(float error) {
+    max_ = std::max(max_, error);
+    sum_ += error;
+    ++count_;
+    const int bucket =
+        error > 0.0f ? static_cast<int>(std::floor(std::log10(error))) + 8 : 0;
+    ++histogram_[std::min(std::max(bucket, 0), kBuckets - 1)];
+  }
+
+  void Report(std::ostream* os) const {
+    *os << "max " << max_ << ", mean " << (count_ ? sum_ / count_ : 0.0)
+        << " [";
+    for (int i = 0; i < kBuckets; i++) {
+      if (i > 0) *os << ", ";
+      if (i < kBuckets - 1) {
+        *os << "<1e" << i - 7;
+      } else {
+        *os << ">=1e" << i - 8;
+      }
+      *os << ": " << histogram_[i];
+    }
+    *os << "]";
+  }
+
+ private:
+  float max_ = 0.0f;
+  double sum_ = 0.0;
+  int64_t count_ = 0;
+  std::array<int64_t, kBuckets> histogram_{};
+};
+
 class CheckNetwork;
 
 class CheckComputation : public NetworkComputation {
  public:
-  CheckComputation(std::unique_ptr<NetworkComputation> refComp,
-                   std::unique_ptr<NetworkComputation> checkComp)
-      : refComp_(std::move(refComp)), checkComp_(std::move(checkComp)) {}
+  // If @async, results are served from @checkComp, and @refComp is computed
+  // later on a thread of @network. Otherwise they are served from @refComp.
+  CheckComputation(CheckNetwork* network,
+                   std::unique_ptr<NetworkComputation> refComp,
+                   std::unique_ptr<NetworkComputation> checkComp, bool async)
+      : network_(network),
+        refComp_(std::move(refComp)),
+        checkComp_(std::move(checkComp)),
+        async_(async),
+        served_(async ? checkComp_.get() : refComp_.get()) {}
 
   void AddInput(InputPlanes&& input) override {
-    InputPlanes x = input;
-    InputPlanes y = input;
-    refComp_->AddInput(std::move(x));
-    checkComp_->AddInput(std::move(y));
+    refComp_->AddInput(InputPlanes(input));
+    checkComp_->AddInput(std::move(input));
   }
 
-  void ComputeBlocking() override {
-    refComp_->ComputeBlocking();
-    checkComp_->ComputeBlocking();
-    Check();
-  }
+  void ComputeBlocking() override;
 
-  int GetBatchSize() const override { return refComp_->GetBatchSize(); }
+  int GetBatchSize() const override { return served_->GetBatchSize(); }
 
-  float GetQVal(int sample) const override { return refComp_->GetQVal(sample); }
+  float GetQVal(int sample) const override { return served_->GetQVal(sample); }
 
   float GetPVal(int sample, int move_id) const override {
-    return refComp_->GetPVal(sample, move_id);
+    return served_->GetPVal(sample, move_id);
+  }
+
+  float GetQAndPVals(int sample, const std::vector<uint16_t>& move_ids,
+                     float* p) const override {
+    return served_->GetQAndPVals(sample, move_ids, p);
   }
 
  private:
-  void Check() {
-    bool valueAlmostEqual = true;
-    int size = GetBatchSize();
-    for (int i = 0; i < size && valueAlmostEqual; i++) {
-      float v1 = refComp_->GetQVal(i);
-      float v2 = checkComp_->GetQVal(i);
-      valueAlmostEqual &= IsAlmostEqual(v1, v2);
-    }
+  CheckNetwork* const network_;
+  std::unique_ptr<NetworkComputation> refComp_;
+  std::unique_ptr<NetworkComputation> checkComp_;
+  const bool async_;
+  NetworkComputation* const served_;
+};
 
-    bool policyAlmostEqual = true;
-    for (int i = 0; i < size && policyAlmostEqual; i++) {
-      for (int j = 0; j < NUM_OUTPUT_POLICY; j++) {
-        float v1 = refComp_->GetPVal(i, j);
-        float v2 = checkComp_->GetPVal(i, j);
-        policyAlmostEqual &= IsAlmostEqual(v1, v2);
+class CheckNetwork : public Network {
+ public:
+  // Backends are configured by "ref" and "check" subdicts, e.g.
+  // ref(backend=blas),check(backend=blas,winograd=4)
+  // By default, opencl is checked against blas.
+  //
+  // Other options:
+  // fraction: share of batches to check, 0.05 by default.
+  // async: serve results of the checked backend, and compute reference on a
+  //   separate thread, so that checking doesn't add latency. Batches are
+  //   skipped if the reference can't keep up.
+  // report_interval: seconds between reports of error statistics.
+  CheckNetwork(const Weights& weights, const OptionsDict& options) {
+    OptionsDict empty;
+    const auto& refOptions =
+        options.HasSubdict("ref") ? options.GetSubdict("ref") : empty;
+    refNet_ = NetworkFactory::Get()->Create(
+        refOptions.GetOrDefault<std::string>("backend", "opencl"), weights,
+        refOptions);
+
+    const auto& checkOptions =
+        options.HasSubdict("check") ? options.GetSubdict("check") : options;
+    checkNet_ = NetworkFactory::Get()->Create(
+        checkOptions.GetOrDefault<std::string>("backend", "blas"), weights,
+        checkOptions);
+
+    fraction_ = options.Exists<int>("fraction")
+                    ? options.Get<int>("fraction")
+                    : options.GetOrDefault<float>("fraction", 0.05f);
+    async_ = options.GetOrDefault<bool>("async", false);
+    report_interval_ =
+        std::chrono::seconds(options.GetOrDefault<int>("report_interval", 10));
+    last_report_ = std::chrono::steady_clock::now();
+    if (async_) thread_ = std::thread([this]() { Worker(); });
+  }
+
+  ~CheckNetwork() {
+    if (async_) {
+      {
+        Mutex::Lock lock(queue_mutex_);
+        stop_ = true;
       }
+      queue_cv_.notify_one();
+      thread_.join();
     }
+    Mutex::Lock lock(stats_mutex_);
+    if (batches_ > 0) Report();
+  }
 
-    // We could also print on standard output using the uci info string
-    // example:
-    //
-    // info string Check passed
-    // info string ***** error chech failed
-    //
-
-    if (valueAlmostEqual && policyAlmostEqual) {
-      std::cerr << "Check passed for a batch of " << size << std::endl;
-      return;
+  std::unique_ptr<NetworkComputation> NewComputation() override {
+    // Checked batches are spread evenly rather than picked at random, so
+    // that random numbers of the search thread are not consumed here.
+    const int64_t batch = batch_counter_++;
+    const bool check = std::floor((batch + 1) * fraction_) >
+                       std::floor(batch * fraction_);
+    if (check) {
+      std::unique_ptr<NetworkComputation> refComp = refNet_->NewComputation();
+      std::unique_ptr<NetworkComputation> checkComp =
+          checkNet_->NewComputation();
+      return std::make_unique<CheckComputation>(this, std::move(refComp),
+                                                std::move(checkComp), async_);
     }
+    return async_ ? checkNet_->NewComputation() : refNet_->NewComputation();
+  }
 
-    if (!valueAlmostEqual && !policyAlmostEqual) {
-      std::cerr << "*** ERROR check failed for a batch of " << size
-                << " both value and policy incorrect" << std::endl;
-      return;
+  // Queues @refComp to be computed and compared with @check.
+  void CheckAsync(std::unique_ptr<NetworkComputation> refComp,
+                  Outputs&& check) {
+    {
+      Mutex::Lock lock(queue_mutex_);
+      if (queue_.size() < kMaxQueuedChecks) {
+        queue_.emplace_back(std::move(refComp), std::move(check));
+        queue_cv_.notify_one();
+        return;
+      }
     }
+    Mutex::Lock lock(stats_mutex_);
+    ++skipped_;
+  }
+
+  // Compares outputs of a batch, and accounts the errors.
+  void Check(const Outputs& ref, const Outputs& check) {
+    // Largest absolute differences, to compare accuracy of backends (or of
+    // their algorithms) which are all "correct".
+    float maxValueError = 0.0f;
+    float maxPolicyError = 0.0f;
+    bool valueAlmostEqual = true;
+    bool policyAlmostEqual = true;
+    const int size = ref.GetBatchSize();
 
-    if (!valueAlmostEqual) {
-      std::cerr << "*** ERROR check failed for a batch of " << size
-                << " value incorrect (but policy ok)" << std::endl;
-      return;
+    Mutex::Lock lock(stats_mutex_);
+    for (int i = 0; i < size; i++) {
+      const float v1 = ref.q[i];
+      const float v2 = check.q[i];
+      valueAlmostEqual &= IsAlmostEqual(v1, v2);
+      maxValueError = std::max(maxValueError, std::abs(v1 - v2));
+      value_errors_.Add(std::abs(v1 - v2));
+
+      float samplePolicyError = 0.0f;
+      for (int j = i * NUM_OUTPUT_POLICY; j < (i + 1) * NUM_OUTPUT_POLICY;
+           j++) {
+        const float p1 = ref.p[j];
+        const float p2 = check.p[j];
+        policyAlmostEqual &= IsAlmostEqual(p1, p2);
+        samplePolicyError = std::max(samplePolicyError, std::abs(p1 - p2));
+      }
+      maxPolicyError = std::max(maxPolicyError, samplePolicyError);
+      policy_errors_.Add(samplePolicyError);
+    }
+    ++batches_;
+
+    if (!valueAlmostEqual || !policyAlmostEqual) {
+      ++failed_;
+      std::cerr << "*** ERROR check failed for a batch of " << size << ", "
+                << (valueAlmostEqual
+                        ? "policy"
+                        : policyAlmostEqual ? "value" : "value and policy")
+                << " incorrect (max value error " << maxValueError
+                << ", max policy error " << maxPolicyError << ")" << std::endl;
     }
 
-    std::cerr << "*** ERROR check failed for a batch of " << size
-              << " policy incorrect (but value ok)" << std::endl;
+    const auto now = std::chrono::steady_clock::now();
+    if (now - last_report_ >= report_interval_) {
+      last_report_ = now;
+      Report();
+    }
   }
 
+ private:
+  // Maximum number of batches waiting for reference computation in async
+  // mode.
+  static constexpr size_t kMaxQueuedChecks = 4;
+
   static bool IsAlmostEqual(float a, float b) {
     constexpr float ABSOLUTE_TOLERANCE = 1e-6;
     constexpr float RELATIVE_TOLERANCE = 1e-2;
 
-    return abs(a - b) <= std::max(RELATIVE_TOLERANCE * std::max(abs(a), abs(b)),
-                                  ABSOLUTE_TOLERANCE);
+    return std::abs(a - b) <=
+           std::max(RELATIVE_TOLERANCE * std::max(std::abs(a), std::abs(b)),
+                    ABSOLUTE_TOLERANCE);
   }
 
-  std::unique_ptr<NetworkComputation> refComp_;
-  std::unique_ptr<NetworkComputation> checkComp_;
-};
-
-class CheckNetwork : public Network {
- public:
-  CheckNetwork(const Weights& weights, const OptionsDict& options) {
-    // TODO:
-    //
-    // Parse the option string and create backends on demand.
-    //
-    // For now, only checking opencl against blas.
-
-    OptionsDict dict1;
-    refNet_ = NetworkFactory::Get()->Create("opencl", weights, dict1);
-
-    OptionsDict dict;
-    checkNet_ = NetworkFactory::Get()->Create("blas", weights, options);
+  void Report() REQUIRES(stats_mutex_) {
+    std::ostringstream oss;
+    oss << "Check: " << batches_ << " batches, " << failed_ << " failed, "
+        << skipped_ << " skipped. Value error: ";
+    value_errors_.Report(&oss);
+    oss << ". Policy error (max per sample): ";
+    policy_errors_.Report(&oss);
+    std::cerr << oss.str() << std::endl;
   }
 
-  static constexpr int CHECK_PROBABILITY = 20;
-
-  std::unique_ptr<NetworkComputation> NewComputation() override {
-    bool check = Random::Get().GetInt(0, CHECK_PROBABILITY) == 0;
-    if (check) {
-      std::unique_ptr<NetworkComputation> refComp = refNet_->NewComputation();
-      std::unique_ptr<NetworkComputation> checkComp =
-          checkNet_->NewComputation();
-      return std::make_unique<CheckComputation>(std::move(refComp),
-                                                std::move(checkComp));
+  void Worker() {
+    while (true) {
+      std::unique_ptr<NetworkComputation> refComp;
+      std::unique_ptr<Outputs> check;
+      {
+        std::unique_lock<std::mutex> lock(queue_mutex_.get_raw());
+        queue_cv_.wait(lock, [this]() { return stop_ || !queue_.empty(); });
+        // Queued checks are dropped when stopping.
+        if (stop_) return;
+        refComp = std::move(queue_.front().first);
+        check = std::make_unique<Outputs>(std::move(queue_.front().second));
+        queue_.pop_front();
+      }
+      refComp->ComputeBlocking();
+      Check(Outputs(*refComp), *check);
     }
-    return refNet_->NewComputation();
   }
 
- private:
   std::unique_ptr<Network> refNet_;
   std::unique_ptr<Network> checkNet_;
+  double fraction_;
+  bool async_;
+  std::atomic<int64_t> batch_counter_{0};
+
+  Mutex queue_mutex_;
+  std::condition_variable queue_cv_;
+  std::deque<std::pair<std::unique_ptr<NetworkComputation>, Outputs>> queue_
+      GUARDED_BY(queue_mutex_);
+  bool stop_ GUARDED_BY(queue_mutex_) = false;
+  std::thread thread_;
+
+  Mutex stats_mutex_;
+  ErrorStats value_errors_ GUARDED_BY(stats_mutex_);
+  ErrorStats policy_errors_ GUARDED_BY(stats_mutex_);
+  int64_t batches_ GUARDED_BY(stats_mutex_) = 0;
+  int64_t failed_ GUARDED_BY(stats_mutex_) = 0;
+  int64_t skipped_ GUARDED_BY(stats_mutex_) = 0;
+  std::chrono::steady_clock::duration report_interval_;
+  std::chrono::steady_clock::time_point last_report_ GUARDED_BY(stats_mutex_);
 };
 
+void CheckComputation::ComputeBlocking() {
+  if (async_) {
+    checkComp_->ComputeBlocking();
+    network_->CheckAsync(std::move(refComp_), Outputs(*checkComp_));
+    return;
+  }
+  refComp_->ComputeBlocking();
+  checkComp_->ComputeBlocking();
+  network_->Check(Outputs(*refComp_), Outputs(*checkComp_));
+}
+
 }  // namespace
 
 REGISTER_NETWORK("check", CheckNetwork, -800)
@@ -635,6 +635,13 @@ class CudnnNetworkComputation : public NetworkComputation {
   float GetPVal(int sample, int move_id) const override {
     return inputs_outputs_->op_policy_mem_[sample * kNumOutputPolicy + move_id];
   }
+  float GetQAndPVals(int sample, const std::vector<uint16_t>& move_ids,
+                     float* p) const override {
+    const float* policy =
+        &inputs_outputs_->op_policy_mem_[sample * kNumOutputPolicy];
+    for (auto move_id : move_ids) *p++ = policy[move_id];
+    return inputs_outputs_->op_value_mem_[sample];
+  }
 
  private:
   // memory holding inputs, outputs
@@ -18,10 +18,13 @@
 
 #include "neural/factory.h"
 
+#include <atomic>
 #include <condition_variable>
 #include <queue>
 #include <thread>
 #include "utils/exception.h"
+#include "utils/metrics.h"
+#include "utils/numa.h"
 
 namespace lczero {
 namespace {
@@ -45,6 +48,11 @@ class MuxingComputation : public NetworkComputation {
     return parent_->GetPVal(sample + idx_in_parent_, move_id);
   }
 
+  float GetQAndPVals(int sample, const std::vector<uint16_t>& move_ids,
+                     float* p) const override {
+    return parent_->GetQAndPVals(sample + idx_in_parent_, move_ids, p);
+  }
+
   void PopulateToParent(std::shared_ptr<NetworkComputation> parent) {
     // Populate our batch into batch of batches.
     parent_ = parent;
@@ -88,6 +96,16 @@ class MuxingNetwork : public Network {
     for (const auto& name : parents) {
       AddBackend(name, weights, options.GetSubdict(name));
     }
+
+    static std::atomic<int> instance_count{0};
+    queue_depth_metric_ = Metrics::Get()->AddGauge(
+        "lc0_mux_queue_depth",
+        "Number of computations waiting for a multiplexing backend thread.",
+        [this]() {
+          std::lock_guard<std::mutex> lock(mutex_);
+          return queue_.size();
+        },
+        "instance=\"" + std::to_string(instance_count++) + "\"");
   }
 
   void AddBackend(const std::string& name, const Weights& weights,
@@ -101,8 +119,12 @@ class MuxingNetwork : public Network {
     Network* net = networks_.back().get();
 
     for (int i = 0; i < nn_threads; ++i) {
-      threads_.emplace_back(
-          [this, net, max_batch]() { Worker(net, max_batch); });
+      // Spread threads of all backends over NUMA nodes.
+      const int thread_idx = threads_.size();
+      threads_.emplace_back([this, net, max_batch, thread_idx]() {
+        BindThreadToNumaNode(thread_idx);
+        Worker(net, max_batch);
+      });
     }
   }
 
@@ -117,6 +139,8 @@ class MuxingNetwork : public Network {
   }
 
   ~MuxingNetwork() {
+    // Stop exporting before the queue is torn down.
+    queue_depth_metric_ = Metrics::Registration();
     Abort();
     Wait();
     // Unstuck waiting computations.
@@ -188,6 +212,8 @@ class MuxingNetwork : public Network {
   std::condition_variable cv_;
 
   std::vector<std::thread> threads_;
+
+  Metrics::Registration queue_depth_metric_;
 };
 
 void MuxingComputation::ComputeBlocking() {
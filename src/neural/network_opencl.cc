@@ -110,6 +110,13 @@ class OpenCLComputation : public NetworkComputation {
     return policy_data_[sample][move_id];
   }
 
+  float GetQAndPVals(int sample, const std::vector<uint16_t>& move_ids,
+                     float* p) const override {
+    const auto& policy = policy_data_[sample];
+    for (auto move_id : move_ids) *p++ = policy[move_id];
+    return q_value_[sample];
+  }
+
  private:
   static void softmax(const std::vector<float>& input,
                       std::vector<float>& output) {
@@ -16,17 +16,16 @@
   along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
 */
 
-#include <chrono>
 #include <functional>
-#include <thread>
 #include "neural/factory.h"
+#include "neural/latency.h"
 #include "utils/hashcat.h"
 
 namespace lczero {
 
 class RandomNetworkComputation : public NetworkComputation {
  public:
-  RandomNetworkComputation(int delay) : delay_ms_(delay) {}
+  RandomNetworkComputation(LatencyModel* latency) : latency_(latency) {}
   void AddInput(InputPlanes&& input) override {
     std::uint64_t hash = 0;
     for (const auto& plane : input) {
@@ -34,11 +33,7 @@ class RandomNetworkComputation : public NetworkComputation {
     }
     inputs_.push_back(hash);
   }
-  void ComputeBlocking() override {
-    if (delay_ms_) {
-      std::this_thread::sleep_for(std::chrono::milliseconds(delay_ms_));
-    }
-  }
+  void ComputeBlocking() override { latency_->Compute(inputs_.size()); }
 
   int GetBatchSize() const override { return inputs_.size(); }
   float GetQVal(int sample) const override {
@@ -49,22 +44,30 @@ class RandomNetworkComputation : public NetworkComputation {
             10000) /
            10000.0;
   }
+  float GetQAndPVals(int sample, const std::vector<uint16_t>& move_ids,
+                     float* p) const override {
+    for (auto move_id : move_ids) {
+      *p++ = RandomNetworkComputation::GetPVal(sample, move_id);
+    }
+    return RandomNetworkComputation::GetQVal(sample);
+  }
 
  private:
   std::vector<std::uint64_t> inputs_;
-  int delay_ms_ = 0;
+  LatencyModel* const latency_;
 };
 
 class RandomNetwork : public Network {
  public:
+  // Takes options of LatencyModel.
   RandomNetwork(const Weights& /*weights*/, const OptionsDict& options)
-      : delay_ms_(options.GetOrDefault<int>("delay", 0)) {}
+      : latency_(options) {}
   std::unique_ptr<NetworkComputation> NewComputation() override {
-    return std::make_unique<RandomNetworkComputation>(delay_ms_);
+    return std::make_unique<RandomNetworkComputation>(&latency_);
   }
 
  private:
-  int delay_ms_ = 0;
+  LatencyModel latency_;
 };
 
 REGISTER_NETWORK("random", RandomNetwork, -900)
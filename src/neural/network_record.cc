@@ -0,0 +1,306 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2018 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <zlib.h>
+#include <atomic>
+#include <cstring>
+#include <iostream>
+#include <unordered_map>
+#include "neural/factory.h"
+#include "neural/latency.h"
+#include "utils/exception.h"
+#include "utils/hashcat.h"
+#include "utils/mutex.h"
+
+namespace lczero {
+
+namespace {
+
+// "record" backend wraps another one and writes every evaluation which search
+// used into a gzipped file. "replay" backend serves evaluations from that
+// file, so that a search can be repeated exactly without the network, e.g.
+// for benchmarks.
+//
+// File format is the version, followed by records, each followed by
+// priors of num_moves moves, in native byte order.
+
+const uint32_t kRecordFormatVersion = 1;
+
+#pragma pack(push, 1)
+
+struct EvaluationRecord {
+  uint64_t hash;
+  float q;
+  uint16_t num_moves;
+};
+
+struct MoveRecord {
+  uint16_t move;
+  float p;
+};
+
+#pragma pack(pop)
+
+// Hash of everything network gets as input.
+uint64_t HashInput(const InputPlanes& input) {
+  uint64_t hash = 0;
+  for (const auto& plane : input) {
+    uint32_t value;
+    std::memcpy(&value, &plane.value, sizeof(value));
+    hash = HashCat({hash, plane.mask, value});
+  }
+  return hash;
+}
+
+class RecordNetwork : public Network {
+ public:
+  // Options:
+  // backend: backend to record, it gets the same options.
+  // file: file to write.
+  RecordNetwork(const Weights& weights, const OptionsDict& options)
+      : filename_(options.Get<std::string>("file")) {
+    parent_ = NetworkFactory::Get()->Create(
+        options.Get<std::string>("backend"), weights, options);
+    file_ = gzopen(filename_.c_str(), "wb");
+    if (!file_) throw Exception("Cannot create file " + filename_);
+    if (!Write(&kRecordFormatVersion, sizeof(kRecordFormatVersion))) {
+      gzclose(file_);
+      throw Exception("Unable to write into " + filename_);
+    }
+  }
+
+  ~RecordNetwork() { gzclose(file_); }
+
+  std::unique_ptr<NetworkComputation> NewComputation() override;
+
+  // Is called from destructors of computations, so doesn't throw. After a
+  // write error (e.g. full disk) reports it and stops recording, the search
+  // goes on.
+  void Write(const EvaluationRecord& record,
+             const std::vector<MoveRecord>& moves) {
+    Mutex::Lock lock(mutex_);
+    if (failed_) return;
+    if (!Write(&record, sizeof(record)) ||
+        !Write(moves.data(), moves.size() * sizeof(MoveRecord))) {
+      std::cerr << "Unable to write into " << filename_
+                << ", recording stopped." << std::endl;
+      failed_ = true;
+    }
+  }
+
+ private:
+  bool Write(const void* data, size_t size) {
+    return gzwrite(file_, data, size) == static_cast<int>(size);
+  }
+
+  std::unique_ptr<Network> parent_;
+  const std::string filename_;
+  Mutex mutex_;
+  gzFile file_;
+  bool failed_ GUARDED_BY(mutex_) = false;
+};
+
+class RecordComputation : public NetworkComputation {
+ public:
+  RecordComputation(std::unique_ptr<NetworkComputation> parent,
+                    RecordNetwork* network)
+      : parent_(std::move(parent)), network_(network) {}
+
+  // Evaluations are written when they can't be queried any more.
+  ~RecordComputation() {
+    if (!computed_) return;
+    for (size_t i = 0; i < hashes_.size(); ++i) {
+      if (moves_[i].empty()) continue;
+      network_->Write({hashes_[i], parent_->GetQVal(i),
+                       static_cast<uint16_t>(moves_[i].size())},
+                      moves_[i]);
+    }
+  }
+
+  void AddInput(InputPlanes&& input) override {
+    hashes_.push_back(HashInput(input));
+    parent_->AddInput(std::move(input));
+  }
+
+  void ComputeBlocking() override {
+    parent_->ComputeBlocking();
+    moves_.resize(hashes_.size());
+    computed_ = true;
+  }
+
+  int GetBatchSize() const override { return parent_->GetBatchSize(); }
+
+  float GetQVal(int sample) const override { return parent_->GetQVal(sample); }
+
+  // Only priors which were queried are recorded, which are usually priors of
+  // legal moves.
+  float GetPVal(int sample, int move_id) const override {
+    const float p = parent_->GetPVal(sample, move_id);
+    moves_[sample].push_back({static_cast<uint16_t>(move_id), p});
+    return p;
+  }
+
+  float GetQAndPVals(int sample, const std::vector<uint16_t>& move_ids,
+                     float* p) const override {
+    const float q = parent_->GetQAndPVals(sample, move_ids, p);
+    for (size_t i = 0; i < move_ids.size(); ++i) {
+      moves_[sample].push_back({move_ids[i], p[i]});
+    }
+    return q;
+  }
+
+ private:
+  std::unique_ptr<NetworkComputation> parent_;
+  RecordNetwork* const network_;
+  std::vector<uint64_t> hashes_;
+  mutable std::vector<std::vector<MoveRecord>> moves_;
+  bool computed_ = false;
+};
+
+std::unique_ptr<NetworkComputation> RecordNetwork::NewComputation() {
+  return std::make_unique<RecordComputation>(parent_->NewComputation(), this);
+}
+
+class ReplayNetwork : public Network {
+ public:
+  struct Evaluation {
+    float q;
+    std::vector<MoveRecord> moves;
+  };
+
+  // Options:
+  // file: file written by "record" backend.
+  // Also takes options of LatencyModel, to simulate time of computation.
+  ReplayNetwork(const Weights& /*weights*/, const OptionsDict& options)
+      : latency_(options) {
+    const auto filename = options.Get<std::string>("file");
+    gzFile file = gzopen(filename.c_str(), "rb");
+    if (!file) throw Exception("Cannot read file " + filename);
+    auto read = [&](void* data, size_t size) {
+      return gzread(file, data, size) == static_cast<int>(size);
+    };
+
+    uint32_t version;
+    if (!read(&version, sizeof(version)) || version != kRecordFormatVersion) {
+      gzclose(file);
+      throw Exception("Unsupported format of " + filename);
+    }
+    EvaluationRecord record;
+    while (read(&record, sizeof(record))) {
+      Evaluation evaluation{record.q,
+                            std::vector<MoveRecord>(record.num_moves)};
+      if (!read(evaluation.moves.data(),
+                record.num_moves * sizeof(MoveRecord))) {
+        gzclose(file);
+        throw Exception("Truncated file " + filename);
+      }
+      evaluations_.emplace(record.hash, std::move(evaluation));
+    }
+    gzclose(file);
+  }
+
+  ~ReplayNetwork() {
+    if (misses_ > 0) {
+      std::cerr << misses_ << " positions were not found in replay file, "
+                << "search went differently from the recorded one."
+                << std::endl;
+    }
+  }
+
+  std::unique_ptr<NetworkComputation> NewComputation() override;
+
+  // Returns recorded evaluation of input with @hash, or nullptr.
+  const Evaluation* Find(uint64_t hash) {
+    auto iter = evaluations_.find(hash);
+    if (iter != evaluations_.end()) return &iter->second;
+    ++misses_;
+    return nullptr;
+  }
+
+  LatencyModel* GetLatencyModel() { return &latency_; }
+
+ private:
+  std::unordered_map<uint64_t, Evaluation> evaluations_;
+  std::atomic<int64_t> misses_{0};
+  LatencyModel latency_;
+};
+
+// Positions which are not found get zero value and priors.
+class ReplayComputation : public NetworkComputation {
+ public:
+  ReplayComputation(ReplayNetwork* network) : network_(network) {}
+
+  void AddInput(InputPlanes&& input) override {
+    evaluations_.push_back(network_->Find(HashInput(input)));
+  }
+
+  void ComputeBlocking() override {
+    network_->GetLatencyModel()->Compute(evaluations_.size());
+  }
+
+  int GetBatchSize() const override { return evaluations_.size(); }
+
+  float GetQVal(int sample) const override {
+    const auto* evaluation = evaluations_[sample];
+    return evaluation ? evaluation->q : 0.0f;
+  }
+
+  float GetPVal(int sample, int move_id) const override {
+    const auto* evaluation = evaluations_[sample];
+    if (!evaluation) return 0.0f;
+    for (const auto& move : evaluation->moves) {
+      if (move.move == move_id) return move.p;
+    }
+    return 0.0f;
+  }
+
+  float GetQAndPVals(int sample, const std::vector<uint16_t>& move_ids,
+                     float* p) const override {
+    const auto* evaluation = evaluations_[sample];
+    if (!evaluation) {
+      std::fill(p, p + move_ids.size(), 0.0f);
+      return 0.0f;
+    }
+    const auto& moves = evaluation->moves;
+    for (size_t i = 0; i < move_ids.size(); ++i) {
+      // Usually moves are queried in the order they were recorded.
+      if (i < moves.size() && moves[i].move == move_ids[i]) {
+        p[i] = moves[i].p;
+      } else {
+        p[i] = GetPVal(sample, move_ids[i]);
+      }
+    }
+    return evaluation->q;
+  }
+
+ private:
+  ReplayNetwork* const network_;
+  std::vector<const ReplayNetwork::Evaluation*> evaluations_;
+};
+
+std::unique_ptr<NetworkComputation> ReplayNetwork::NewComputation() {
+  return std::make_unique<ReplayComputation>(this);
+}
+
+}  // namespace
+
+REGISTER_NETWORK("record", RecordNetwork, -1000)
+REGISTER_NETWORK("replay", ReplayNetwork, -1000)
+
+}  // namespace lczero
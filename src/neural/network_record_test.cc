@@ -0,0 +1,99 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2018 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "neural/factory.h"
+
+namespace lczero {
+
+namespace {
+const int kBatchSize = 5;
+
+InputPlanes MakeInput(int sample) {
+  InputPlanes input(kInputPlanes);
+  for (int i = 0; i < kInputPlanes; ++i) {
+    input[i].mask = 0x9E3779B97F4A7C15ull * (sample * kInputPlanes + i + 1);
+    input[i].value = 1.0f + i % 3;
+  }
+  return input;
+}
+
+// Evaluates kBatchSize inputs, starting from input @first, and returns Q
+// values followed by priors of @moves for every sample.
+std::vector<float> Evaluate(Network* network, int first,
+                            const std::vector<uint16_t>& moves) {
+  auto computation = network->NewComputation();
+  for (int i = 0; i < kBatchSize; ++i) {
+    computation->AddInput(MakeInput(first + i));
+  }
+  computation->ComputeBlocking();
+  std::vector<float> result;
+  for (int i = 0; i < kBatchSize; ++i) {
+    std::vector<float> p(moves.size());
+    result.push_back(computation->GetQAndPVals(i, moves, p.data()));
+    result.insert(result.end(), p.begin(), p.end());
+  }
+  return result;
+}
+}  // namespace
+
+TEST(RecordReplay, ReplayReturnsRecordedEvaluations) {
+  const std::string filename = ::testing::TempDir() + "record_test.gz";
+  const std::vector<uint16_t> moves = {0, 17, 322, 1857};
+  Weights weights;
+
+  std::vector<float> recorded;
+  {
+    auto record = NetworkFactory::Get()->Create(
+        "record", weights,
+        OptionsDict::FromString("backend=random,file='" + filename + "'"));
+    recorded = Evaluate(record.get(), 0, moves);
+  }
+
+  auto replay = NetworkFactory::Get()->Create(
+      "replay", weights, OptionsDict::FromString("file='" + filename + "'"));
+  EXPECT_EQ(Evaluate(replay.get(), 0, moves), recorded);
+
+  // Priors queried in other order are found too.
+  const std::vector<uint16_t> reversed(moves.rbegin(), moves.rend());
+  const auto replayed = Evaluate(replay.get(), 0, reversed);
+  const size_t stride = moves.size() + 1;
+  for (int i = 0; i < kBatchSize; ++i) {
+    EXPECT_EQ(replayed[i * stride], recorded[i * stride]);
+    for (size_t j = 0; j < moves.size(); ++j) {
+      EXPECT_EQ(replayed[i * stride + 1 + j],
+                recorded[i * stride + moves.size() - j]);
+    }
+  }
+
+  // Positions which were not recorded get zero value and priors.
+  for (float value : Evaluate(replay.get(), kBatchSize, moves)) {
+    EXPECT_EQ(value, 0.0f);
+  }
+  std::remove(filename.c_str());
+}
+
+}  // namespace lczero
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -193,6 +193,12 @@ class TFNetworkComputation : public NetworkComputation {
   float GetPVal(int sample, int move_id) const override {
     return output_[1].template matrix<float>()(sample, move_id);
   }
+  float GetQAndPVals(int sample, const std::vector<uint16_t>& move_ids,
+                     float* p) const override {
+    const auto policy = output_[1].template matrix<float>();
+    for (auto move_id : move_ids) *p++ = policy(sample, move_id);
+    return output_[0].template matrix<float>()(sample, 0);
+  }
 
  private:
   void PrepareInput();
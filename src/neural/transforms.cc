@@ -88,87 +88,67 @@ std::vector<float> Transforms::WinogradTransformF(const std::vector<float>& f,
   return U;
 }
 
+template <int kChannels>
 void Transforms::WinogradTransformIn(const std::vector<float>& in,
-                                       std::vector<float>& V, const int C) {
+                                     std::vector<float>& V,
+                                     const int channels) {
+  const int C = kChannels != 0 ? kChannels : channels;
+  assert(C == channels);
   constexpr auto W = 8;
   constexpr auto H = 8;
   constexpr auto wtiles = (W + 1) / 2;
   constexpr auto P = wtiles * wtiles;
+  // Input plane with zero padding around it, so that tiles are read without
+  // bounds checks.
+  constexpr auto kPaddedW = W + 2;
+  std::array<float, kPaddedW*(H + 2)> padded{};
 
   for (auto ch = 0; ch < C; ch++) {
-    for (auto block_y = 0; block_y < wtiles; block_y++) {
-      for (auto block_x = 0; block_x < wtiles; block_x++) {
-        // Tiles overlap by 2
-        const auto yin = 2 * block_y - 1;
-        const auto xin = 2 * block_x - 1;
-
-        // Cache input tile and handle zero padding
-        using WinogradTile =
-            std::array<std::array<float, kWinogradAlpha>, kWinogradAlpha>;
-        WinogradTile x;
-
-        for (auto i = 0; i < kWinogradAlpha; i++) {
-          for (auto j = 0; j < kWinogradAlpha; j++) {
-            if ((yin + i) >= 0 && (xin + j) >= 0 && (yin + i) < H &&
-                (xin + j) < W) {
-              x[i][j] = in[ch * (W * H) + (yin + i) * W + (xin + j)];
-            } else {
-              x[i][j] = 0.0f;
-            }
-          }
-        }
+    for (auto y = 0; y < H; y++) {
+      std::copy_n(&in[ch * (W * H) + y * W], W,
+                  &padded[(y + 1) * kPaddedW + 1]);
+    }
 
-        const auto offset = ch * P + block_y * wtiles + block_x;
-
-        // Calculates transpose(B).x.B
-        // B = [[ 1.0,  0.0,  0.0,  0.0],
-        //      [ 0.0,  1.0, -1.0,  1.0],
-        //      [-1.0,  1.0,  1.0,  0.0],
-        //      [ 0.0,  0.0,  0.0, -1.0]]
-
-        WinogradTile T1, T2;
-
-        T1[0][0] = x[0][0] - x[2][0];
-        T1[0][1] = x[0][1] - x[2][1];
-        T1[0][2] = x[0][2] - x[2][2];
-        T1[0][3] = x[0][3] - x[2][3];
-        T1[1][0] = x[1][0] + x[2][0];
-        T1[1][1] = x[1][1] + x[2][1];
-        T1[1][2] = x[1][2] + x[2][2];
-        T1[1][3] = x[1][3] + x[2][3];
-        T1[2][0] = x[2][0] - x[1][0];
-        T1[2][1] = x[2][1] - x[1][1];
-        T1[2][2] = x[2][2] - x[1][2];
-        T1[2][3] = x[2][3] - x[1][3];
-        T1[3][0] = x[1][0] - x[3][0];
-        T1[3][1] = x[1][1] - x[3][1];
-        T1[3][2] = x[1][2] - x[3][2];
-        T1[3][3] = x[1][3] - x[3][3];
-
-        T2[0][0] = T1[0][0] - T1[0][2];
-        T2[0][1] = T1[0][1] + T1[0][2];
-        T2[0][2] = T1[0][2] - T1[0][1];
-        T2[0][3] = T1[0][1] - T1[0][3];
-        T2[1][0] = T1[1][0] - T1[1][2];
-        T2[1][1] = T1[1][1] + T1[1][2];
-        T2[1][2] = T1[1][2] - T1[1][1];
-        T2[1][3] = T1[1][1] - T1[1][3];
-        T2[2][0] = T1[2][0] - T1[2][2];
-        T2[2][1] = T1[2][1] + T1[2][2];
-        T2[2][2] = T1[2][2] - T1[2][1];
-        T2[2][3] = T1[2][1] - T1[2][3];
-        T2[3][0] = T1[3][0] - T1[3][2];
-        T2[3][1] = T1[3][1] + T1[3][2];
-        T2[3][2] = T1[3][2] - T1[3][1];
-        T2[3][3] = T1[3][1] - T1[3][3];
-
-        for (auto i = 0; i < kWinogradAlpha; i++) {
-          for (auto j = 0; j < kWinogradAlpha; j++) {
-            V[(i * kWinogradAlpha + j) * C * P + offset] = T2[i][j];
+    // x[i][j][tile] is element (i, j) of every tile. Tiles overlap by 2.
+    std::array<std::array<std::array<float, P>, kWinogradAlpha>,
+               kWinogradAlpha>
+        x;
+    for (auto i = 0; i < kWinogradAlpha; i++) {
+      for (auto j = 0; j < kWinogradAlpha; j++) {
+        for (auto block_y = 0; block_y < wtiles; block_y++) {
+          for (auto block_x = 0; block_x < wtiles; block_x++) {
+            x[i][j][block_y * wtiles + block_x] =
+                padded[(2 * block_y + i) * kPaddedW + 2 * block_x + j];
           }
         }
       }
     }
+
+    // Calculates transpose(B).x.B
+    // B = [[ 1.0,  0.0,  0.0,  0.0],
+    //      [ 0.0,  1.0, -1.0,  1.0],
+    //      [-1.0,  1.0,  1.0,  0.0],
+    //      [ 0.0,  0.0,  0.0, -1.0]]
+    // Innermost loops go over all tiles, so that they are vectorized.
+    decltype(x) T1;
+    for (auto j = 0; j < kWinogradAlpha; j++) {
+      for (auto tile = 0; tile < P; tile++) {
+        T1[0][j][tile] = x[0][j][tile] - x[2][j][tile];
+        T1[1][j][tile] = x[1][j][tile] + x[2][j][tile];
+        T1[2][j][tile] = x[2][j][tile] - x[1][j][tile];
+        T1[3][j][tile] = x[1][j][tile] - x[3][j][tile];
+      }
+    }
+    for (auto i = 0; i < kWinogradAlpha; i++) {
+      const auto& t = T1[i];
+      float* out = &V[i * kWinogradAlpha * C * P + ch * P];
+      for (auto tile = 0; tile < P; tile++) {
+        out[0 * C * P + tile] = t[0][tile] - t[2][tile];
+        out[1 * C * P + tile] = t[1][tile] + t[2][tile];
+        out[2 * C * P + tile] = t[2][tile] - t[1][tile];
+        out[3 * C * P + tile] = t[1][tile] - t[3][tile];
+      }
+    }
   }
 }
 
@@ -187,77 +167,291 @@ void Transforms::WinogradSgemm(const std::vector<float>& U,
   }
 }
 
+template <int kChannels>
 void Transforms::WinogradTransformOut(const std::vector<float>& M,
-                                        std::vector<float>& Y, const int K) {
+                                      std::vector<float>& Y,
+                                      const int channels) {
+  const int K = kChannels != 0 ? kChannels : channels;
+  assert(K == channels);
   constexpr auto W = 8;
   constexpr auto H = 8;
   constexpr auto wtiles = (W + 1) / 2;
   constexpr auto P = wtiles * wtiles;
 
   for (auto k = 0; k < K; k++) {
-    for (auto block_x = 0; block_x < wtiles; block_x++) {
-      for (auto block_y = 0; block_y < wtiles; block_y++) {
+    // m[xi * kWinogradAlpha + nu] points to element (xi, nu) of all tiles.
+    std::array<const float*, kWinogradTile> m;
+    for (auto i = 0; i < kWinogradTile; i++) m[i] = &M[i * (K * P) + k * P];
+
+    // Calculates transpose(A).temp_m.A
+    //    A = [1.0,  0.0],
+    //        [1.0,  1.0],
+    //        [1.0, -1.0],
+    //        [0.0, -1.0]]
+    // Innermost loops go over all tiles, so that they are vectorized.
+    std::array<float, P> o11, o12, o21, o22;
+    for (auto b = 0; b < P; b++) {
+      o11[b] = m[0 * 4 + 0][b] + m[0 * 4 + 1][b] + m[0 * 4 + 2][b] +
+               m[1 * 4 + 0][b] + m[1 * 4 + 1][b] + m[1 * 4 + 2][b] +
+               m[2 * 4 + 0][b] + m[2 * 4 + 1][b] + m[2 * 4 + 2][b];
+
+      o12[b] = m[0 * 4 + 1][b] - m[0 * 4 + 2][b] - m[0 * 4 + 3][b] +
+               m[1 * 4 + 1][b] - m[1 * 4 + 2][b] - m[1 * 4 + 3][b] +
+               m[2 * 4 + 1][b] - m[2 * 4 + 2][b] - m[2 * 4 + 3][b];
+
+      o21[b] = m[1 * 4 + 0][b] + m[1 * 4 + 1][b] + m[1 * 4 + 2][b] -
+               m[2 * 4 + 0][b] - m[2 * 4 + 1][b] - m[2 * 4 + 2][b] -
+               m[3 * 4 + 0][b] - m[3 * 4 + 1][b] - m[3 * 4 + 2][b];
+
+      o22[b] = m[1 * 4 + 1][b] - m[1 * 4 + 2][b] - m[1 * 4 + 3][b] -
+               m[2 * 4 + 1][b] + m[2 * 4 + 2][b] + m[2 * 4 + 3][b] -
+               m[3 * 4 + 1][b] + m[3 * 4 + 2][b] + m[3 * 4 + 3][b];
+    }
+
+    // Tiles cover the board exactly, no need to clip.
+    float* out = &Y[k * (H * W)];
+    for (auto block_y = 0; block_y < wtiles; block_y++) {
+      for (auto block_x = 0; block_x < wtiles; block_x++) {
+        const auto b = block_y * wtiles + block_x;
         const auto x = 2 * block_x;
         const auto y = 2 * block_y;
+        out[y * W + x] = o11[b];
+        out[y * W + x + 1] = o12[b];
+        out[(y + 1) * W + x] = o21[b];
+        out[(y + 1) * W + x + 1] = o22[b];
+      }
+    }
+  }
+}
 
-        const auto b = block_y * wtiles + block_x;
-        std::array<float, kWinogradTile> temp_m;
-        for (auto xi = 0; xi < kWinogradAlpha; xi++) {
-          for (auto nu = 0; nu < kWinogradAlpha; nu++) {
-            temp_m[xi * kWinogradAlpha + nu] =
-                M[xi * (kWinogradAlpha * K * P) + nu * (K * P) + k * P + b];
+template <int kOutputs>
+void Transforms::WinogradConvolve3(const int outputs,
+                                   const std::vector<float>& input,
+                                   const std::vector<float>& U,
+                                   std::vector<float>& V, std::vector<float>& M,
+                                   std::vector<float>& output) {
+  constexpr unsigned int filter_len = kWinogradAlpha * kWinogradAlpha;
+  const int input_channels = U.size() / (outputs * filter_len);
+
+  if (input_channels == kOutputs) {
+    WinogradTransformIn<kOutputs>(input, V, input_channels);
+  } else {
+    WinogradTransformIn(input, V, input_channels);
+  }
+  WinogradSgemm(U, V, M, input_channels, outputs);
+  WinogradTransformOut<kOutputs>(M, output, outputs);
+}
+
+std::vector<float> Transforms::WinogradTransformF4x4(
+    const std::vector<float>& f, const int outputs, const int channels) {
+  // F(4x4, 3x3) Winograd filter transformation
+  // transpose(G.dot(f).dot(G.transpose()))
+  // U matrix is transposed for better memory layout in SGEMM
+  constexpr auto kAlpha = kWinograd4x4Alpha;
+  auto U = std::vector<float>(kWinograd4x4Tile * outputs * channels);
+  const auto G = std::array<float, kAlpha * 3>{
+      1.0f / 4,  0.0f,       0.0f,      -1.0f / 6, -1.0f / 6, -1.0f / 6,
+      -1.0f / 6, 1.0f / 6,   -1.0f / 6, 1.0f / 24, 1.0f / 12, 1.0f / 6,
+      1.0f / 24, -1.0f / 12, 1.0f / 6,  0.0f,      0.0f,      1.0f};
+  auto temp = std::array<float, kAlpha * 3>{};
+
+  for (auto o = 0; o < outputs; o++) {
+    for (auto c = 0; c < channels; c++) {
+      for (auto i = 0; i < kAlpha; i++) {
+        for (auto j = 0; j < 3; j++) {
+          auto acc = 0.0f;
+          for (auto k = 0; k < 3; k++) {
+            acc += G[i * 3 + k] * f[o * channels * 9 + c * 9 + k * 3 + j];
           }
+          temp[i * 3 + j] = acc;
         }
+      }
 
-        // Calculates transpose(A).temp_m.A
-        //    A = [1.0,  0.0],
-        //        [1.0,  1.0],
-        //        [1.0, -1.0],
-        //        [0.0, -1.0]]
+      for (auto xi = 0; xi < kAlpha; xi++) {
+        for (auto nu = 0; nu < kAlpha; nu++) {
+          auto acc = 0.0f;
+          for (int k = 0; k < 3; k++) {
+            acc += temp[xi * 3 + k] * G[nu * 3 + k];
+          }
+          U[xi * (kAlpha * outputs * channels) + nu * (outputs * channels) +
+            c * outputs + o] = acc;
+        }
+      }
+    }
+  }
 
-        auto o11 = temp_m[0 * 4 + 0] + temp_m[0 * 4 + 1] + temp_m[0 * 4 + 2] +
-                   temp_m[1 * 4 + 0] + temp_m[1 * 4 + 1] + temp_m[1 * 4 + 2] +
-                   temp_m[2 * 4 + 0] + temp_m[2 * 4 + 1] + temp_m[2 * 4 + 2];
+  return U;
+}
 
-        auto o12 = temp_m[0 * 4 + 1] - temp_m[0 * 4 + 2] - temp_m[0 * 4 + 3] +
-                   temp_m[1 * 4 + 1] - temp_m[1 * 4 + 2] - temp_m[1 * 4 + 3] +
-                   temp_m[2 * 4 + 1] - temp_m[2 * 4 + 2] - temp_m[2 * 4 + 3];
+namespace {
+// Multiplies 6 values, @stride apart, by transpose(B) of F(4x4, 3x3):
+// B^T = [[4,  0, -5,  0, 1, 0],
+//        [0, -4, -4,  1, 1, 0],
+//        [0,  4, -4, -1, 1, 0],
+//        [0, -2, -1,  2, 1, 0],
+//        [0,  2, -1, -2, 1, 0],
+//        [0,  4,  0, -5, 0, 1]]
+inline void WinogradInRow4x4(const float* d, int stride, float* out,
+                             int out_stride) {
+  const float d0 = d[0 * stride], d1 = d[1 * stride], d2 = d[2 * stride],
+              d3 = d[3 * stride], d4 = d[4 * stride], d5 = d[5 * stride];
+  out[0 * out_stride] = 4.0f * d0 - 5.0f * d2 + d4;
+  out[1 * out_stride] = -4.0f * (d1 + d2) + d3 + d4;
+  out[2 * out_stride] = 4.0f * (d1 - d2) - d3 + d4;
+  out[3 * out_stride] = 2.0f * (d3 - d1) - d2 + d4;
+  out[4 * out_stride] = 2.0f * (d1 - d3) - d2 + d4;
+  out[5 * out_stride] = 4.0f * d1 - 5.0f * d3 + d5;
+}
 
-        auto o21 = temp_m[1 * 4 + 0] + temp_m[1 * 4 + 1] + temp_m[1 * 4 + 2] -
-                   temp_m[2 * 4 + 0] - temp_m[2 * 4 + 1] - temp_m[2 * 4 + 2] -
-                   temp_m[3 * 4 + 0] - temp_m[3 * 4 + 1] - temp_m[3 * 4 + 2];
+// Multiplies 6 values, @stride apart, by transpose(A) of F(4x4, 3x3):
+// A^T = [[1, 1,  1, 1,  1, 0],
+//        [0, 1, -1, 2, -2, 0],
+//        [0, 1,  1, 4,  4, 0],
+//        [0, 1, -1, 8, -8, 1]]
+inline void WinogradOutRow4x4(const float* m, int stride, float* out,
+                              int out_stride) {
+  const float m0 = m[0 * stride], m1 = m[1 * stride], m2 = m[2 * stride],
+              m3 = m[3 * stride], m4 = m[4 * stride], m5 = m[5 * stride];
+  const float sum12 = m1 + m2, diff12 = m1 - m2;
+  const float sum34 = m3 + m4, diff34 = m3 - m4;
+  out[0 * out_stride] = m0 + sum12 + sum34;
+  out[1 * out_stride] = diff12 + 2.0f * diff34;
+  out[2 * out_stride] = sum12 + 4.0f * sum34;
+  out[3 * out_stride] = diff12 + 8.0f * diff34 + m5;
+}
+}  // namespace
+
+template <int kChannels>
+void Transforms::WinogradTransformIn4x4(const std::vector<float>& in,
+                                        std::vector<float>& V,
+                                        const int channels) {
+  const int C = kChannels != 0 ? kChannels : channels;
+  assert(C == channels);
+  constexpr auto W = 8;
+  constexpr auto H = 8;
+  constexpr auto kAlpha = kWinograd4x4Alpha;
+  constexpr auto wtiles = W / 4;
+  constexpr auto P = kWinograd4x4Tiles;
 
-        auto o22 = temp_m[1 * 4 + 1] - temp_m[1 * 4 + 2] - temp_m[1 * 4 + 3] -
-                   temp_m[2 * 4 + 1] + temp_m[2 * 4 + 2] + temp_m[2 * 4 + 3] -
-                   temp_m[3 * 4 + 1] + temp_m[3 * 4 + 2] + temp_m[3 * 4 + 3];
+  // Input plane with zero padding around it, so that tiles are read without
+  // bounds checks.
+  constexpr auto kPaddedW = W + 2;
+  std::array<float, kPaddedW*(H + 2)> padded{};
 
-        Y[k * (H * W) + (y)*W + (x)] = o11;
-        if (x + 1 < W) {
-          Y[k * (H * W) + (y)*W + (x + 1)] = o12;
-        }
-        if (y + 1 < H) {
-          Y[k * (H * W) + (y + 1) * W + (x)] = o21;
-          if (x + 1 < W) {
-            Y[k * (H * W) + (y + 1) * W + (x + 1)] = o22;
+  for (auto ch = 0; ch < C; ch++) {
+    for (auto y = 0; y < H; y++) {
+      std::copy_n(&in[ch * (W * H) + y * W], W,
+                  &padded[(y + 1) * kPaddedW + 1]);
+    }
+
+    // x[(i * kAlpha + j) * P + tile] is element (i, j) of a tile. Tiles
+    // overlap by 2.
+    std::array<float, kWinograd4x4Tile * P> x, T1;
+    for (auto i = 0; i < kAlpha; i++) {
+      for (auto j = 0; j < kAlpha; j++) {
+        for (auto block_y = 0; block_y < wtiles; block_y++) {
+          for (auto block_x = 0; block_x < wtiles; block_x++) {
+            x[(i * kAlpha + j) * P + block_y * wtiles + block_x] =
+                padded[(4 * block_y + i) * kPaddedW + 4 * block_x + j];
           }
         }
       }
     }
+
+    // Calculates transpose(B).x.B, columns first. Innermost loops go over
+    // all tiles, so that they are vectorized.
+    for (auto j = 0; j < kAlpha; j++) {
+      for (auto tile = 0; tile < P; tile++) {
+        WinogradInRow4x4(&x[j * P + tile], kAlpha * P, &T1[j * P + tile],
+                         kAlpha * P);
+      }
+    }
+    for (auto i = 0; i < kAlpha; i++) {
+      for (auto tile = 0; tile < P; tile++) {
+        WinogradInRow4x4(&T1[i * kAlpha * P + tile], P,
+                         &V[i * kAlpha * C * P + ch * P + tile], C * P);
+      }
+    }
   }
 }
 
-void Transforms::WinogradConvolve3(const int outputs,
-                                    const std::vector<float>& input,
-                                    const std::vector<float>& U,
-                                    std::vector<float>& V,
-                                    std::vector<float>& M,
-                                    std::vector<float>& output) {
-  constexpr unsigned int filter_len = kWinogradAlpha * kWinogradAlpha;
-  const auto input_channels = U.size() / (outputs * filter_len);
+void Transforms::WinogradSgemm4x4(const std::vector<float>& U,
+                                  std::vector<float>& V, std::vector<float>& M,
+                                  const int C, const int K) {
+  constexpr auto P = kWinograd4x4Tiles;
 
-  WinogradTransformIn(input, V, input_channels);
-  WinogradSgemm(U, V, M, input_channels, outputs);
-  WinogradTransformOut(M, output, outputs);
+  for (auto b = 0; b < kWinograd4x4Tile; b++) {
+    auto offset_u = b * K * C;
+    auto offset_v = b * C * P;
+    auto offset_m = b * K * P;
+
+    cblas_sgemm(CblasRowMajor, CblasTrans, CblasNoTrans, K, P, C, 1.0f,
+                &U[offset_u], K, &V[offset_v], P, 0.0f, &M[offset_m], P);
+  }
+}
+
+template <int kChannels>
+void Transforms::WinogradTransformOut4x4(const std::vector<float>& M,
+                                         std::vector<float>& Y,
+                                         const int channels) {
+  const int K = kChannels != 0 ? kChannels : channels;
+  assert(K == channels);
+  constexpr auto W = 8;
+  constexpr auto H = 8;
+  constexpr auto kAlpha = kWinograd4x4Alpha;
+  constexpr auto wtiles = W / 4;
+  constexpr auto P = kWinograd4x4Tiles;
+
+  for (auto k = 0; k < K; k++) {
+    // Calculates transpose(A).m.A, columns first. Innermost loops go over
+    // all tiles, so that they are vectorized. Element (xi, nu) of tile b is
+    // at M[(xi * kAlpha + nu) * (K * P) + k * P + b].
+    std::array<float, 4 * kAlpha * P> T1;
+    std::array<float, 4 * 4 * P> T2;
+    for (auto j = 0; j < kAlpha; j++) {
+      for (auto b = 0; b < P; b++) {
+        WinogradOutRow4x4(&M[j * (K * P) + k * P + b], kAlpha * (K * P),
+                          &T1[j * P + b], kAlpha * P);
+      }
+    }
+    for (auto i = 0; i < 4; i++) {
+      for (auto b = 0; b < P; b++) {
+        WinogradOutRow4x4(&T1[i * kAlpha * P + b], P, &T2[i * 4 * P + b], P);
+      }
+    }
+
+    // The board is divided into tiles exactly, so there is no clipping.
+    float* out = &Y[k * (H * W)];
+    for (auto block_y = 0; block_y < wtiles; block_y++) {
+      for (auto block_x = 0; block_x < wtiles; block_x++) {
+        const auto b = block_y * wtiles + block_x;
+        for (auto i = 0; i < 4; i++) {
+          for (auto j = 0; j < 4; j++) {
+            out[(4 * block_y + i) * W + 4 * block_x + j] =
+                T2[(i * 4 + j) * P + b];
+          }
+        }
+      }
+    }
+  }
+}
+
+template <int kOutputs>
+void Transforms::WinogradConvolve3F4x4(const int outputs,
+                                       const std::vector<float>& input,
+                                       const std::vector<float>& U,
+                                       std::vector<float>& V,
+                                       std::vector<float>& M,
+                                       std::vector<float>& output) {
+  const int input_channels = U.size() / (outputs * kWinograd4x4Tile);
+
+  if (input_channels == kOutputs) {
+    WinogradTransformIn4x4<kOutputs>(input, V, input_channels);
+  } else {
+    WinogradTransformIn4x4(input, V, input_channels);
+  }
+  WinogradSgemm4x4(U, V, M, input_channels, outputs);
+  WinogradTransformOut4x4<kOutputs>(M, output, outputs);
 }
 
 template <unsigned int filter_size>
@@ -302,6 +496,26 @@ void Transforms::Convolve(size_t outputs, const std::vector<float>& input,
   }
 }
 
+void Transforms::Convolve1x1Batchnorm(size_t outputs,
+                                      const std::vector<float>& input,
+                                      const std::vector<float>& weights,
+                                      const float* means, const float* stddivs,
+                                      std::vector<float>& output) {
+  constexpr unsigned int board_squares = 8 * 8;
+  const auto input_channels = weights.size() / outputs;
+  assert(outputs * board_squares == output.size());
+
+  // outputs[outputs,8x8] = weights[outputs,input_channels] x
+  //                        input[input_channels,8x8]
+  cblas_sgemm(CblasRowMajor, CblasNoTrans, CblasNoTrans,
+              // M        N              K
+              outputs, board_squares, input_channels, 1.0f, weights.data(),
+              input_channels, input.data(), board_squares, 0.0f, output.data(),
+              board_squares);
+
+  Batchnorm<board_squares>(outputs, output, means, stddivs);
+}
+
 void Transforms::Innerproduct(const std::vector<float>& inputs,
                               const std::vector<float>& weights,
                               const std::vector<float>& biases,
@@ -322,13 +536,15 @@ void Transforms::Innerproduct(const std::vector<float>& inputs,
   }
 }
 
-template <size_t spatial_size>
+template <size_t spatial_size, int kChannels>
 void Transforms::Batchnorm(size_t channels, std::vector<float>& data,
                            const float* means, const float* stddivs,
                            const float* eltwise) {
+  const size_t C = kChannels != 0 ? kChannels : channels;
+  assert(C == channels);
   auto lambda_ReLU = [](float val) { return (val > 0.0f) ? val : 0.0f; };
 
-  for (auto c = size_t{0}; c < channels; ++c) {
+  for (auto c = size_t{0}; c < C; ++c) {
     auto mean = means[c];
     auto scale_stddiv = stddivs[c];
 
@@ -438,11 +654,33 @@ void Transforms::Im2Col<1>(const int channels, const std::vector<float>& input,
   std::copy(begin(input), begin(input) + outSize, begin(output));
 }
 
-template void Transforms::Batchnorm<64>(size_t channels,
-                                        std::vector<float>& data,
-                                        const float* means,
-                                        const float* stddivs,
-                                        const float* eltwise);
+#define INSTANTIATE_FOR_FILTERS(filters)                                   \
+  template void Transforms::WinogradTransformIn<filters>(                 \
+      const std::vector<float>& in, std::vector<float>& V, const int C);  \
+  template void Transforms::WinogradTransformOut<filters>(                \
+      const std::vector<float>& M, std::vector<float>& Y, const int K);   \
+  template void Transforms::WinogradConvolve3<filters>(                   \
+      const int outputs, const std::vector<float>& input,                 \
+      const std::vector<float>& U, std::vector<float>& V,                 \
+      std::vector<float>& M, std::vector<float>& output);                 \
+  template void Transforms::WinogradTransformIn4x4<filters>(              \
+      const std::vector<float>& in, std::vector<float>& V, const int C);  \
+  template void Transforms::WinogradTransformOut4x4<filters>(             \
+      const std::vector<float>& M, std::vector<float>& Y, const int K);   \
+  template void Transforms::WinogradConvolve3F4x4<filters>(               \
+      const int outputs, const std::vector<float>& input,                 \
+      const std::vector<float>& U, std::vector<float>& V,                 \
+      std::vector<float>& M, std::vector<float>& output);                 \
+  template void Transforms::Batchnorm<64, filters>(                       \
+      size_t channels, std::vector<float> & data, const float* means,     \
+      const float* stddivs, const float* eltwise);
+
+INSTANTIATE_FOR_FILTERS(0)
+INSTANTIATE_FOR_FILTERS(64)
+INSTANTIATE_FOR_FILTERS(128)
+INSTANTIATE_FOR_FILTERS(192)
+INSTANTIATE_FOR_FILTERS(256)
+#undef INSTANTIATE_FOR_FILTERS
 
 template void Transforms::Convolve<1>(size_t outputs,
                                       const std::vector<float>& input,
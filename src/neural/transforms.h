@@ -23,10 +23,13 @@
 
 namespace lczero {
 
+// Functions templated on kChannels (or kOutputs) are instantiated for the
+// common numbers of filters (64, 128, 192 and 256), so that loops and strides
+// depending on number of channels are known at compile time. 0 means the
+// generic version, which takes channel count from the arguments. Specialized
+// versions must be called with the matching channel count.
 class Transforms {
  public:
-  
-  
   static constexpr auto kWinogradAlpha = 4;
   static constexpr auto kWinogradTile = kWinogradAlpha * kWinogradAlpha;
 
@@ -40,33 +43,79 @@ class Transforms {
                                                  const int outputs,
                                                  const int channels);
 
+  template <int kChannels = 0>
   static void WinogradTransformIn(const std::vector<float>& in,
                                     std::vector<float>& V, const int C);
 
   static void WinogradSgemm(const std::vector<float>& U, std::vector<float>& V,
                              std::vector<float>& M, const int C, const int K);
 
+  template <int kChannels = 0>
   static void WinogradTransformOut(const std::vector<float>& M,
                                      std::vector<float>& Y, const int K);
 
+  // Input transform is specialized only if number of input channels is also
+  // kOutputs.
+  template <int kOutputs = 0>
   static void WinogradConvolve3(const int outputs,
                                  const std::vector<float>& input,
                                  const std::vector<float>& U,
                                  std::vector<float>& V, std::vector<float>& M,
                                  std::vector<float>& output);
 
+  // F(4x4, 3x3) variant: 6x6 input tiles, 4 tiles per board, 36 multiplies
+  // per 16 outputs instead of 16 per 4.
+  static constexpr auto kWinograd4x4Alpha = 6;
+  static constexpr auto kWinograd4x4Tile =
+      kWinograd4x4Alpha * kWinograd4x4Alpha;
+  static constexpr auto kWinograd4x4Tiles = 4;
+
+  static std::vector<float> WinogradTransformF4x4(const std::vector<float>& f,
+                                                  const int outputs,
+                                                  const int channels);
+
+  template <int kChannels = 0>
+  static void WinogradTransformIn4x4(const std::vector<float>& in,
+                                     std::vector<float>& V, const int C);
+
+  static void WinogradSgemm4x4(const std::vector<float>& U,
+                               std::vector<float>& V, std::vector<float>& M,
+                               const int C, const int K);
+
+  template <int kChannels = 0>
+  static void WinogradTransformOut4x4(const std::vector<float>& M,
+                                      std::vector<float>& Y, const int K);
+
+  template <int kOutputs = 0>
+  static void WinogradConvolve3F4x4(const int outputs,
+                                    const std::vector<float>& input,
+                                    const std::vector<float>& U,
+                                    std::vector<float>& V,
+                                    std::vector<float>& M,
+                                    std::vector<float>& output);
+
   template <unsigned int filter_size>
   static void Convolve(size_t outputs, const std::vector<float>& input,
                        const std::vector<float>& weights,
                        const std::vector<float>& biases,
                        std::vector<float>& output);
 
+  // 1x1 convolution of 8x8 planes, done as a single GEMM straight on @input,
+  // followed by batchnorm and ReLU in place. Convolution biases are not
+  // added, they are expected to be folded into @means by
+  // OffsetBatchNormMeans().
+  static void Convolve1x1Batchnorm(size_t outputs,
+                                   const std::vector<float>& input,
+                                   const std::vector<float>& weights,
+                                   const float* means, const float* stddivs,
+                                   std::vector<float>& output);
+
   static void Innerproduct(const std::vector<float>& input,
                            const std::vector<float>& weights,
                            const std::vector<float>& biases,
                            std::vector<float>& output, bool apply_relu = false);
 
-  template <size_t spatial_size>
+  template <size_t spatial_size, int kChannels = 0>
   static void Batchnorm(size_t channels, std::vector<float>& data,
                         const float* means, const float* stddivs,
                         const float* eltwise = nullptr);
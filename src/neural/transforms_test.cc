@@ -0,0 +1,115 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2018 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "neural/transforms.h"
+#include <gtest/gtest.h>
+#include <cmath>
+#include <random>
+#include <vector>
+
+namespace lczero {
+
+namespace {
+const int kWidth = 8;
+const int kHeight = 8;
+const int kSquares = kWidth * kHeight;
+
+std::vector<float> RandomVector(size_t size, std::mt19937* gen) {
+  std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+  std::vector<float> result(size);
+  for (auto& x : result) x = dist(*gen);
+  return result;
+}
+
+// Plain 3x3 convolution with zero padding. @weights are laid out as
+// [outputs][channels][3][3].
+std::vector<float> DirectConvolve3(int outputs, int channels,
+                                   const std::vector<float>& input,
+                                   const std::vector<float>& weights) {
+  std::vector<float> output(outputs * kSquares);
+  for (int o = 0; o < outputs; ++o) {
+    for (int y = 0; y < kHeight; ++y) {
+      for (int x = 0; x < kWidth; ++x) {
+        double sum = 0.0;
+        for (int c = 0; c < channels; ++c) {
+          for (int dy = 0; dy < 3; ++dy) {
+            for (int dx = 0; dx < 3; ++dx) {
+              const int iy = y + dy - 1;
+              const int ix = x + dx - 1;
+              if (iy < 0 || iy >= kHeight || ix < 0 || ix >= kWidth) continue;
+              sum += input[(c * kHeight + iy) * kWidth + ix] *
+                     weights[((o * channels + c) * 3 + dy) * 3 + dx];
+            }
+          }
+        }
+        output[(o * kHeight + y) * kWidth + x] = sum;
+      }
+    }
+  }
+  return output;
+}
+
+template <int kOutputs>
+void CheckWinograd(int outputs, int channels, bool f4x4) {
+  std::mt19937 gen(outputs * 1000 + channels);
+  const auto input = RandomVector(channels * kSquares, &gen);
+  const auto weights = RandomVector(outputs * channels * 9, &gen);
+  const auto expected = DirectConvolve3(outputs, channels, input, weights);
+
+  const int transformed_size =
+      f4x4 ? Transforms::kWinograd4x4Tile * Transforms::kWinograd4x4Tiles
+           : Transforms::kWinogradTile * (kSquares / 4);
+  std::vector<float> V(transformed_size * channels);
+  std::vector<float> M(transformed_size * outputs);
+  std::vector<float> output(outputs * kSquares);
+  if (f4x4) {
+    const auto U =
+        Transforms::WinogradTransformF4x4(weights, outputs, channels);
+    Transforms::WinogradConvolve3F4x4<kOutputs>(outputs, input, U, V, M,
+                                                output);
+  } else {
+    const auto U = Transforms::WinogradTransformF(weights, outputs, channels);
+    Transforms::WinogradConvolve3<kOutputs>(outputs, input, U, V, M, output);
+  }
+
+  // Sums of 9 * channels products of values up to 1.
+  const float tolerance = 1e-4f * std::sqrt(9.0f * channels);
+  for (size_t i = 0; i < output.size(); ++i) {
+    ASSERT_NEAR(output[i], expected[i], tolerance) << "at " << i;
+  }
+}
+}  // namespace
+
+TEST(Winograd, F2x2MatchesDirectConvolution) {
+  CheckWinograd<0>(16, 8, false);
+  CheckWinograd<64>(64, 64, false);
+}
+
+TEST(Winograd, F4x4MatchesDirectConvolution) {
+  CheckWinograd<0>(16, 8, true);
+  CheckWinograd<0>(64, 112, true);
+  CheckWinograd<64>(64, 64, true);
+  CheckWinograd<128>(128, 128, true);
+}
+
+}  // namespace lczero
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -19,17 +19,29 @@
 #include "neural/writer.h"
 
 #include <iomanip>
+#include <random>
 #include <sstream>
 #include "utils/commandline.h"
 #include "utils/exception.h"
 #include "utils/filesystem.h"
-#include "utils/random.h"
 
 namespace lczero {
 
+namespace {
+// Not using Random::Get() as it may be seeded for reproducibility, while the
+// directory name must be different for every run.
+std::string GetRunDirectorySuffix() {
+  std::random_device rd;
+  std::uniform_int_distribution<> dist('a', 'z');
+  std::string result;
+  for (int i = 0; i < 12; ++i) result += dist(rd);
+  return result;
+}
+}  // namespace
+
 TrainingDataWriter::TrainingDataWriter(int game_id) {
   static std::string directory =
-      CommandLine::BinaryDirectory() + "/data-" + Random::Get().GetString(12);
+      CommandLine::BinaryDirectory() + "/data-" + GetRunDirectorySuffix();
   // It's fine if it already exists.
   CreateDirectory(directory.c_str());
 
@@ -18,6 +18,9 @@
 
 #include "selfplay/loop.h"
 #include "selfplay/tournament.h"
+#include "utils/largepages.h"
+#include "utils/numa.h"
+#include "utils/metrics.h"
 
 namespace lczero {
 
@@ -35,8 +38,15 @@ SelfPlayLoop::~SelfPlayLoop() {
 void SelfPlayLoop::RunLoop() {
   options_.Add<BoolOption>(kInteractive, "interactive") = false;
   SelfPlayTournament::PopulateOptions(&options_);
+  MetricsExporter::PopulateOptions(&options_);
+  PopulateLargePagesOptions(&options_);
+  PopulateNumaOptions(&options_);
 
   if (!options_.ProcessAllFlags()) return;
+  ConfigureLargePages(options_.GetOptionsDict());
+  ConfigureNuma(options_.GetOptionsDict());
+  const auto metrics_exporter =
+      MetricsExporter::Create(options_.GetOptionsDict());
   if (options_.GetOptionsDict().Get<bool>(kInteractive)) {
     UciLoop::RunLoop();
   } else {
@@ -40,6 +40,7 @@ const char* kTrainingStr = "Write training data";
 const char* kNnBackendStr = "NN backend to use";
 const char* kNnBackendOptionsStr = "NN backend parameters";
 const char* kVerboseThinkingStr = "Show verbose thinking messages";
+const char* kSeedStr = "Random seed, 0 for random";
 
 // Value for network autodiscover.
 const char* kAutoDiscover = "<autodiscover>";
@@ -65,6 +66,7 @@ void SelfPlayTournament::PopulateOptions(OptionsParser* options) {
       "multiplexing";
   options->Add<StringOption>(kNnBackendOptionsStr, "backend-opts");
   options->Add<BoolOption>(kVerboseThinkingStr, "verbose-thinking") = false;
+  options->Add<IntOption>(kSeedStr, 0, 999999999, "seed") = 0;
 
   Search::PopulateUciParams(options);
   auto defaults = options->GetMutableDefaultsOptions();
@@ -94,9 +96,10 @@ SelfPlayTournament::SelfPlayTournament(const OptionsDict& options,
       kShareTree(options.Get<bool>(kShareTreesStr)),
       kParallelism(options.Get<int>(kParallelGamesStr)),
       kTraining(options.Get<bool>(kTrainingStr)) {
+  Random::SetSeed(options.Get<int>(kSeedStr));
   // If playing just one game, the player1 is white, otherwise randomize.
   if (kTotalGames != 1) {
-    next_game_black_ = Random::Get().GetBool();
+    first_game_black_ = Random::Get().GetBool();
   }
 
   static const char* kPlayerNames[2] = {"player1", "player2"};
@@ -146,6 +149,14 @@ SelfPlayTournament::SelfPlayTournament(const OptionsDict& options,
     cache_[1] = std::make_shared<NNCache>(
         options.GetSubdict("player2").Get<int>(kNnCacheSizeStr));
   }
+  for (int idx : {0, 1}) {
+    if (idx == 1 && cache_[1] == cache_[0]) break;
+    for (auto& registration : RegisterCacheMetrics(
+             cache_[idx].get(),
+             std::string("player=\"") + kPlayerNames[idx] + "\"")) {
+      cache_metrics_.push_back(std::move(registration));
+    }
+  }
 
   // SearchLimits.
   for (int idx : {0, 1}) {
@@ -166,12 +177,10 @@ SelfPlayTournament::SelfPlayTournament(const OptionsDict& options,
 }
 
 void SelfPlayTournament::PlayOneGame(int game_number) {
-  bool player1_black;  // Whether player1 will player as black in this game.
-  {
-    Mutex::Lock lock(mutex_);
-    player1_black = next_game_black_;
-    next_game_black_ = !next_game_black_;
-  }
+  // Make random numbers of the game not depend on which thread plays it.
+  Random::Get().Reseed({static_cast<std::uint64_t>(game_number)});
+  // Whether player1 will player as black in this game.
+  const bool player1_black = first_game_black_ != (game_number % 2 == 1);
   const int color_idx[2] = {player1_black ? 1 : 0, player1_black ? 0 : 1};
 
   PlayerOptions options[2];
@@ -57,9 +57,10 @@ class SelfPlayTournament {
   void Worker();
   void PlayOneGame(int game_id);
 
+  // Whether the first game will be black for player1. Colors alternate in
+  // later games, by game number rather than by order games start in.
+  bool first_game_black_ = false;
   Mutex mutex_;
-  // Whether next game will be black for player1.
-  bool next_game_black_ GUARDED_BY(mutex_) = false;
   // Number of games which already started.
   int games_count_ GUARDED_BY(mutex_) = 0;
   bool abort_ GUARDED_BY(mutex_) = false;
@@ -77,6 +78,7 @@ class SelfPlayTournament {
   // Shared pointers for both players may point to the same object.
   std::shared_ptr<Network> networks_[2];
   std::shared_ptr<NNCache> cache_[2];
+  std::vector<Metrics::Registration> cache_metrics_;
   const OptionsDict player_options_[2];
   SearchLimits search_limits_[2];
 
@@ -18,18 +18,26 @@
 
 #pragma once
 
+#include <algorithm>
 #include <cassert>
 #include <cstring>
 #include <memory>
 #include <string>
+#include <vector>
+#include "utils/largepages.h"
 #include "utils/mutex.h"
 
 namespace lczero {
 
 // Generic LRU cache. Thread-safe.
+// Items are allocated from an arena of 2MB chunks (size of a huge page), so
+// that lookups walk compact memory which may be backed by large pages. Chunks
+// which have no items are returned when the capacity is reduced or the cache
+// is cleared.
 template <class K, class V>
 class LruCache {
   static const double constexpr kLoadFactor = 1.33;
+  static const size_t constexpr kArenaChunkBytes = 2 * 1024 * 1024;
 
  public:
   LruCache(int capacity = 128)
@@ -63,7 +71,7 @@ class LruCache {
     ShrinkToCapacity(capacity_ - 1);
     ++size_;
     ++allocated_;
-    Item* new_item = new Item(key, std::move(val), pinned ? 1 : 0);
+    Item* new_item = NewItem(key, std::move(val), pinned ? 1 : 0);
     new_item->next_in_hash = hash_head;
     hash_head = new_item;
     InsertIntoLru(new_item);
@@ -92,9 +100,11 @@ class LruCache {
       if (key == iter->key) {
         // BringToFront(iter);
         ++iter->pins;
+        ++hits_;
         return iter->value.get();
       }
     }
+    ++misses_;
     return nullptr;
   }
 
@@ -109,7 +119,7 @@ class LruCache {
         if (--el->pins == 0) {
           *cur = el->next_in_hash;
           --allocated_;
-          delete el;
+          DeleteItem(el);
         }
         return;
       }
@@ -135,6 +145,7 @@ class LruCache {
     Mutex::Lock lock(mutex_);
 
     if (capacity_ == capacity) return;
+    const bool shrinking = capacity < capacity_;
     ShrinkToCapacity(capacity);
     capacity_ = capacity;
 
@@ -143,20 +154,24 @@ class LruCache {
 
     if (size_ != 0) {
       for (Item* head : hash_) {
-        for (Item* iter = head; head; head = head->next_in_hash) {
+        for (Item* iter = head; iter;) {
+          Item* next = iter->next_in_hash;
           auto& new_hash_head = new_hash[hasher_(iter->key) % new_hash.size()];
           iter->next_in_hash = new_hash_head;
           new_hash_head = iter;
+          iter = next;
         }
       }
     }
     hash_.swap(new_hash);
+    if (shrinking) ReleaseFreeChunks();
   }
 
   // Clears the cache;
   void Clear() {
     Mutex::Lock lock(mutex_);
     ShrinkToCapacity(0);
+    ReleaseFreeChunks();
   }
 
   int GetSize() const {
@@ -167,6 +182,16 @@ class LruCache {
     Mutex::Lock lock(mutex_);
     return capacity_;
   }
+  // Number of Lookup() calls which found / didn't find the key, since the
+  // cache was created.
+  int64_t GetHits() const {
+    Mutex::Lock lock(mutex_);
+    return hits_;
+  }
+  int64_t GetMisses() const {
+    Mutex::Lock lock(mutex_);
+    return misses_;
+  }
 
  private:
   struct Item {
@@ -180,6 +205,90 @@ class LruCache {
     Item* next_in_queue = nullptr;
   };
 
+  // Free slot of the arena, or an item.
+  union Slot {
+    Slot* next_free;
+    Item item;
+
+    Slot() {}
+    ~Slot() {}
+  };
+
+  Item* NewItem(K key, std::unique_ptr<V> value, int pins) REQUIRES(mutex_) {
+    if (!free_slots_) GrowArena();
+    Slot* slot = free_slots_;
+    free_slots_ = slot->next_free;
+    return new (&slot->item) Item(key, std::move(value), pins);
+  }
+
+  void DeleteItem(Item* item) REQUIRES(mutex_) {
+    item->~Item();
+    Slot* slot = reinterpret_cast<Slot*>(item);
+    slot->next_free = free_slots_;
+    free_slots_ = slot;
+  }
+
+  // Adds a chunk of slots. Chunks are kept sorted by address.
+  void GrowArena() REQUIRES(mutex_) {
+    PageAllocation chunk(sizeof(Slot) > kArenaChunkBytes ? sizeof(Slot)
+                                                         : kArenaChunkBytes);
+    Slot* begin = static_cast<Slot*>(chunk.get());
+    // Allocation may be rounded up to page size, use all of it.
+    const size_t count = chunk.size() / sizeof(Slot);
+    // Pushing in reverse, so that items are taken in address order.
+    for (size_t i = count; i-- > 0;) {
+      begin[i].next_free = free_slots_;
+      free_slots_ = &begin[i];
+    }
+    arena_.insert(arena_.begin() + (ChunkOf(begin) + 1), std::move(chunk));
+  }
+
+  // Returns index of the chunk which contains @slot, or -1 if @slot is
+  // before all chunks.
+  int64_t ChunkOf(const Slot* slot) const REQUIRES(mutex_) {
+    auto iter = std::upper_bound(
+        arena_.begin(), arena_.end(), slot,
+        [](const Slot* slot, const PageAllocation& chunk) {
+          return slot < static_cast<const Slot*>(chunk.get());
+        });
+    return iter - arena_.begin() - 1;
+  }
+
+  // Returns chunks where all slots are free to the system.
+  void ReleaseFreeChunks() REQUIRES(mutex_) {
+    if (allocated_ == 0) {
+      free_slots_ = nullptr;
+      arena_.clear();
+      return;
+    }
+    std::vector<size_t> free_count(arena_.size());
+    for (Slot* slot = free_slots_; slot; slot = slot->next_free) {
+      ++free_count[ChunkOf(slot)];
+    }
+    std::vector<bool> release(arena_.size());
+    bool any_released = false;
+    for (size_t i = 0; i < arena_.size(); ++i) {
+      release[i] = free_count[i] == arena_[i].size() / sizeof(Slot);
+      any_released |= release[i];
+    }
+    if (!any_released) return;
+
+    // Unlinks slots of released chunks, keeping order of the rest.
+    Slot** cur = &free_slots_;
+    while (*cur) {
+      if (release[ChunkOf(*cur)]) {
+        *cur = (*cur)->next_free;
+      } else {
+        cur = &(*cur)->next_free;
+      }
+    }
+    size_t kept = 0;
+    for (size_t i = 0; i < arena_.size(); ++i) {
+      if (!release[i]) arena_[kept++] = std::move(arena_[i]);
+    }
+    arena_.erase(arena_.begin() + kept, arena_.end());
+  }
+
   void EvictItem(Item* iter) REQUIRES(mutex_) {
     --size_;
 
@@ -202,7 +311,7 @@ class LruCache {
         *cur = el->next_in_hash;
         if (el->pins == 0) {
           --allocated_;
-          delete el;
+          DeleteItem(el);
         } else {
           el->next_in_hash = evicted_head_;
           evicted_head_ = el;
@@ -254,11 +363,15 @@ class LruCache {
   int capacity_ GUARDED_BY(mutex_);
   int size_ GUARDED_BY(mutex_) = 0;
   int allocated_ GUARDED_BY(mutex_) = 0;
+  int64_t hits_ GUARDED_BY(mutex_) = 0;
+  int64_t misses_ GUARDED_BY(mutex_) = 0;
   Item* lru_head_ GUARDED_BY(mutex_) = nullptr;  // Newest elements.
   Item* lru_tail_ GUARDED_BY(mutex_) = nullptr;  // Oldest elements.
   Item* evicted_head_ GUARDED_BY(mutex_) =
       nullptr;  // Evicted but pinned elements.
   std::vector<Item*> hash_ GUARDED_BY(mutex_);
+  std::vector<PageAllocation> arena_ GUARDED_BY(mutex_);
+  Slot* free_slots_ GUARDED_BY(mutex_) = nullptr;
   std::hash<K> hasher_ GUARDED_BY(mutex_);
 
   mutable Mutex mutex_;
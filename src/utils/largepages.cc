@@ -0,0 +1,145 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2018 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "utils/largepages.h"
+
+#include <atomic>
+#include <iostream>
+#include <new>
+#include <vector>
+#include "utils/metrics.h"
+
+namespace lczero {
+
+namespace {
+const char* kLargePagesStr = "Large pages for tree and cache";
+
+const char* kOff = "off";
+const char* kTransparent = "transparent";
+const char* kExplicit = "explicit";
+
+std::atomic<LargePages> gLargePages{LargePages::kOff};
+
+// Bytes currently allocated in every kind of pages, and number of
+// allocations which didn't get requested kind.
+std::atomic<int64_t> gBytes[3];
+std::atomic<int64_t> gFallbacks{0};
+
+const char* PagesName(LargePages pages) {
+  switch (pages) {
+    case LargePages::kOff:
+      return "regular";
+    case LargePages::kTransparent:
+      return "transparent";
+    case LargePages::kExplicit:
+      return "explicit";
+  }
+  return "";
+}
+
+void SetLargePages(const std::string& value) {
+  if (value == kTransparent) {
+    gLargePages = LargePages::kTransparent;
+  } else if (value == kExplicit) {
+    gLargePages = LargePages::kExplicit;
+  } else {
+    gLargePages = LargePages::kOff;
+  }
+}
+
+class PageMetrics {
+ public:
+  PageMetrics() {
+    auto* metrics = Metrics::Get();
+    for (auto pages : {LargePages::kOff, LargePages::kTransparent,
+                       LargePages::kExplicit}) {
+      registrations_.push_back(metrics->AddGauge(
+          "lc0_page_allocations_bytes",
+          "Memory of tree and cache, by kind of pages backing it.",
+          [pages]() { return gBytes[static_cast<int>(pages)].load(); },
+          std::string("pages=\"") + PagesName(pages) + "\""));
+    }
+    registrations_.push_back(metrics->AddCounter(
+        "lc0_page_allocation_fallbacks_total",
+        "Allocations which didn't get requested kind of pages.",
+        []() { return gFallbacks.load(); }));
+    registrations_.push_back(metrics->AddGauge(
+        "lc0_transparent_huge_pages_bytes",
+        "Process memory which the kernel backs by transparent huge pages.",
+        []() { return PageAllocation::GetTransparentHugePagesBytes(); }));
+  }
+
+ private:
+  std::vector<Metrics::Registration> registrations_;
+};
+
+PageMetrics gPageMetrics;
+
+}  // namespace
+
+void PopulateLargePagesOptions(OptionsParser* options) {
+  options->Add<ChoiceOption>(
+      kLargePagesStr, std::vector<std::string>{kOff, kTransparent, kExplicit},
+      "large-pages", '\0', &SetLargePages) = kOff;
+}
+
+void ConfigureLargePages(const OptionsDict& options) {
+  SetLargePages(options.Get<std::string>(kLargePagesStr));
+}
+
+PageAllocation::PageAllocation(size_t size) : size_(size) {
+  const LargePages requested = gLargePages;
+  pages_ = requested;
+  memory_ = Map(&size_, &pages_);
+  if (!memory_) throw std::bad_alloc();
+  if (pages_ != requested) {
+    // Let user know once that the setting has no effect.
+    if (gFallbacks++ == 0) {
+      std::cerr << "Cannot allocate " << PagesName(requested)
+                << " huge pages, using " << PagesName(pages_) << " pages."
+                << std::endl;
+    }
+  }
+  gBytes[static_cast<int>(pages_)] += size_;
+}
+
+PageAllocation::PageAllocation(PageAllocation&& other)
+    : memory_(other.memory_), size_(other.size_), pages_(other.pages_) {
+  other.memory_ = nullptr;
+}
+
+PageAllocation& PageAllocation::operator=(PageAllocation&& other) {
+  if (this == &other) return *this;
+  Release();
+  memory_ = other.memory_;
+  size_ = other.size_;
+  pages_ = other.pages_;
+  other.memory_ = nullptr;
+  return *this;
+}
+
+PageAllocation::~PageAllocation() { Release(); }
+
+void PageAllocation::Release() {
+  if (!memory_) return;
+  gBytes[static_cast<int>(pages_)] -= size_;
+  Unmap(memory_, size_);
+  memory_ = nullptr;
+}
+
+}  // namespace lczero
@@ -0,0 +1,79 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2018 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include "utils/optionsdict.h"
+#include "utils/optionsparser.h"
+
+namespace lczero {
+
+// Kind of pages to back big randomly accessed structures (search tree, NN
+// cache) with. Large pages make every TLB entry cover 2MB instead of 4KB.
+enum class LargePages {
+  // Regular pages.
+  kOff,
+  // Transparent huge pages, which the kernel uses when it can (Linux only).
+  kTransparent,
+  // Explicitly reserved huge pages (MAP_HUGETLB on Linux, MEM_LARGE_PAGES on
+  // Windows). Have to be configured by administrator.
+  kExplicit,
+};
+
+// Populates command line options for large pages.
+void PopulateLargePagesOptions(OptionsParser* options);
+// Sets kind of pages for allocations made after the call.
+void ConfigureLargePages(const OptionsDict& options);
+
+// Memory block allocated directly from the OS, page aligned and zeroed. If
+// pages of requested kind are unavailable, falls back to the next smaller
+// kind, so that only running out of memory throws (std::bad_alloc). Pages
+// actually used are exported as metrics.
+class PageAllocation {
+ public:
+  PageAllocation() = default;
+  explicit PageAllocation(size_t size);
+  PageAllocation(PageAllocation&& other);
+  PageAllocation& operator=(PageAllocation&& other);
+  ~PageAllocation();
+
+  void* get() const { return memory_; }
+  // Size of the block, which may be rounded up from the requested size.
+  size_t size() const { return size_; }
+  LargePages pages() const { return pages_; }
+
+  // Returns bytes of process memory in transparent huge pages, or 0 if it's
+  // not known. Platform specific, like Map() and Unmap().
+  static size_t GetTransparentHugePagesBytes();
+
+ private:
+  void Release();
+
+  // Platform specific, in largepages.posix.cc and largepages.win32.cc.
+  // Maps at least @size bytes, preferably backed by @pages. Updates @size and
+  // @pages to what was actually mapped. Returns nullptr on failure.
+  static void* Map(size_t* size, LargePages* pages);
+  static void Unmap(void* memory, size_t size);
+
+  void* memory_ = nullptr;
+  size_t size_ = 0;
+  LargePages pages_ = LargePages::kOff;
+};
+
+}  // namespace lczero
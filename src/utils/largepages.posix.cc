@@ -0,0 +1,112 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2018 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "utils/largepages.h"
+
+#include <sys/mman.h>
+#include <unistd.h>
+#include <cstdint>
+#include <fstream>
+#include <string>
+
+#if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+namespace lczero {
+
+namespace {
+// Default huge page size of x86-64 and most of ARM64 systems.
+const size_t kHugePageSize = 2 * 1024 * 1024;
+
+size_t RoundUp(size_t size, size_t alignment) {
+  return (size + alignment - 1) / alignment * alignment;
+}
+
+void* MapAnonymous(size_t size, int extra_flags) {
+  void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | extra_flags, -1, 0);
+  return memory == MAP_FAILED ? nullptr : memory;
+}
+
+#ifdef MADV_HUGEPAGE
+// Transparent huge pages are only used for 2MB aligned ranges, so maps more
+// than needed and unmaps the unaligned head and tail.
+void* MapTransparent(size_t size) {
+  char* raw = static_cast<char*>(MapAnonymous(size + kHugePageSize, 0));
+  if (!raw) return nullptr;
+  char* aligned = reinterpret_cast<char*>(
+      RoundUp(reinterpret_cast<uintptr_t>(raw), kHugePageSize));
+  if (aligned != raw) munmap(raw, aligned - raw);
+  munmap(aligned + size, raw + kHugePageSize - aligned);
+  if (madvise(aligned, size, MADV_HUGEPAGE) != 0) {
+    munmap(aligned, size);
+    return nullptr;
+  }
+  return aligned;
+}
+#endif
+
+}  // namespace
+
+void* PageAllocation::Map(size_t* size, LargePages* pages) {
+#ifdef MAP_HUGETLB
+  if (*pages == LargePages::kExplicit) {
+    const size_t rounded = RoundUp(*size, kHugePageSize);
+    void* memory = MapAnonymous(rounded, MAP_HUGETLB);
+    if (memory) {
+      *size = rounded;
+      return memory;
+    }
+  }
+#endif
+  if (*pages != LargePages::kOff) *pages = LargePages::kTransparent;
+
+#ifdef MADV_HUGEPAGE
+  if (*pages == LargePages::kTransparent) {
+    const size_t rounded = RoundUp(*size, kHugePageSize);
+    void* memory = MapTransparent(rounded);
+    if (memory) {
+      *size = rounded;
+      return memory;
+    }
+  }
+#endif
+  *pages = LargePages::kOff;
+
+  *size = RoundUp(*size, sysconf(_SC_PAGESIZE));
+  return MapAnonymous(*size, 0);
+}
+
+void PageAllocation::Unmap(void* memory, size_t size) { munmap(memory, size); }
+
+size_t PageAllocation::GetTransparentHugePagesBytes() {
+  // Sums AnonHugePages of all mappings, in kB.
+  std::ifstream smaps("/proc/self/smaps");
+  size_t total_kb = 0;
+  std::string line;
+  const std::string key = "AnonHugePages:";
+  while (std::getline(smaps, line)) {
+    if (line.compare(0, key.size(), key) == 0) {
+      total_kb += std::stoull(line.substr(key.size()));
+    }
+  }
+  return total_kb * 1024;
+}
+
+}  // namespace lczero
@@ -0,0 +1,84 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2018 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "utils/largepages.h"
+
+#include <windows.h>
+
+namespace lczero {
+
+namespace {
+// Large pages can only be allocated by a process which holds "Lock pages in
+// memory" privilege. The user has to be granted it by administrator, then
+// it has to be enabled for the process.
+bool EnableLockMemoryPrivilege() {
+  HANDLE token;
+  if (!OpenProcessToken(GetCurrentProcess(),
+                        TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &token)) {
+    return false;
+  }
+  TOKEN_PRIVILEGES privileges{};
+  privileges.PrivilegeCount = 1;
+  privileges.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+  bool result = LookupPrivilegeValueA(nullptr, "SeLockMemoryPrivilege",
+                                      &privileges.Privileges[0].Luid) &&
+                AdjustTokenPrivileges(token, FALSE, &privileges, 0, nullptr,
+                                      nullptr) &&
+                GetLastError() == ERROR_SUCCESS;
+  CloseHandle(token);
+  return result;
+}
+
+size_t RoundUp(size_t size, size_t alignment) {
+  return (size + alignment - 1) / alignment * alignment;
+}
+}  // namespace
+
+void* PageAllocation::Map(size_t* size, LargePages* pages) {
+  if (*pages == LargePages::kExplicit) {
+    static const bool privilege_enabled = EnableLockMemoryPrivilege();
+    const size_t large_page_size = GetLargePageMinimum();
+    if (privilege_enabled && large_page_size > 0) {
+      const size_t rounded = RoundUp(*size, large_page_size);
+      void* memory =
+          VirtualAlloc(nullptr, rounded,
+                       MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES,
+                       PAGE_READWRITE);
+      if (memory) {
+        *size = rounded;
+        return memory;
+      }
+    }
+  }
+  // There are no transparent huge pages on Windows.
+  *pages = LargePages::kOff;
+
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  *size = RoundUp(*size, info.dwPageSize);
+  return VirtualAlloc(nullptr, *size, MEM_RESERVE | MEM_COMMIT,
+                      PAGE_READWRITE);
+}
+
+void PageAllocation::Unmap(void* memory, size_t /*size*/) {
+  VirtualFree(memory, 0, MEM_RELEASE);
+}
+
+size_t PageAllocation::GetTransparentHugePagesBytes() { return 0; }
+
+}  // namespace lczero
@@ -0,0 +1,251 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2018 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "utils/metrics.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+namespace lczero {
+
+namespace {
+const char* kMetricsFileStr = "Metrics file";
+const char* kMetricsIntervalStr = "Metrics export interval in milliseconds";
+
+std::string FormatValue(double value) {
+  if (std::isinf(value)) return value > 0 ? "+Inf" : "-Inf";
+  if (std::isnan(value)) return "NaN";
+  // Print counters as integers, so that large values don't lose precision.
+  if (value == std::floor(value) && std::fabs(value) < 1e15) {
+    return std::to_string(static_cast<int64_t>(value));
+  }
+  std::ostringstream oss;
+  oss.precision(10);
+  oss << value;
+  return oss.str();
+}
+
+std::string JoinLabels(const std::string& a, const std::string& b) {
+  if (a.empty()) return b;
+  if (b.empty()) return a;
+  return a + "," + b;
+}
+
+std::string WithLabels(const std::string& name, const std::string& labels) {
+  if (labels.empty()) return name;
+  return name + "{" + labels + "}";
+}
+}  // namespace
+
+/////////////////////////////////////////////////////////////////////////
+// Metrics::Histogram
+/////////////////////////////////////////////////////////////////////////
+
+Metrics::Histogram::Histogram(std::vector<double> bounds)
+    : bounds_(std::move(bounds)), counts_(bounds_.size() + 1) {}
+
+void Metrics::Histogram::Add(double value) {
+  const size_t idx =
+      std::lower_bound(bounds_.begin(), bounds_.end(), value) - bounds_.begin();
+  Mutex::Lock lock(mutex_);
+  ++counts_[idx];
+  ++total_count_;
+  sum_ += value;
+}
+
+double Metrics::Histogram::GetQuantile(double quantile) const {
+  Mutex::Lock lock(mutex_);
+  if (total_count_ == 0) return 0.0;
+  const double rank = quantile * total_count_;
+  uint64_t cumulative = 0;
+  for (size_t i = 0; i < counts_.size(); ++i) {
+    if (cumulative + counts_[i] < rank || counts_[i] == 0) {
+      cumulative += counts_[i];
+      continue;
+    }
+    // The +Inf bucket has no upper bound, report the largest finite one.
+    if (i == bounds_.size()) return bounds_.empty() ? 0.0 : bounds_.back();
+    const double lower = i == 0 ? 0.0 : bounds_[i - 1];
+    return lower + (bounds_[i] - lower) * (rank - cumulative) / counts_[i];
+  }
+  return bounds_.empty() ? 0.0 : bounds_.back();
+}
+
+void Metrics::Histogram::Render(const std::string& name,
+                                const std::string& labels,
+                                std::string* out) const {
+  Mutex::Lock lock(mutex_);
+  uint64_t cumulative = 0;
+  for (size_t i = 0; i < counts_.size(); ++i) {
+    cumulative += counts_[i];
+    const std::string le =
+        i == bounds_.size() ? "+Inf" : FormatValue(bounds_[i]);
+    *out += WithLabels(name + "_bucket", JoinLabels(labels, "le=\"" + le + "\""));
+    *out += " " + std::to_string(cumulative) + "\n";
+  }
+  *out += WithLabels(name + "_sum", labels) + " " + FormatValue(sum_) + "\n";
+  *out += WithLabels(name + "_count", labels) + " " +
+          std::to_string(total_count_) + "\n";
+}
+
+/////////////////////////////////////////////////////////////////////////
+// Metrics
+/////////////////////////////////////////////////////////////////////////
+
+Metrics::Registration& Metrics::Registration::operator=(Registration&& other) {
+  if (id_ >= 0) Metrics::Get()->Remove(id_);
+  id_ = other.id_;
+  other.id_ = -1;
+  return *this;
+}
+
+Metrics::Registration::~Registration() {
+  if (id_ >= 0) Metrics::Get()->Remove(id_);
+}
+
+Metrics* Metrics::Get() {
+  // Never destroyed, as metrics may be unregistered by global objects during
+  // shutdown.
+  static Metrics* metrics = new Metrics();
+  return metrics;
+}
+
+Metrics::Registration Metrics::AddCounter(const std::string& name,
+                                          const std::string& help,
+                                          Callback callback,
+                                          const std::string& labels) {
+  return Add({0, name, help, "counter", labels, callback, nullptr});
+}
+
+Metrics::Registration Metrics::AddGauge(const std::string& name,
+                                        const std::string& help,
+                                        Callback callback,
+                                        const std::string& labels) {
+  return Add({0, name, help, "gauge", labels, callback, nullptr});
+}
+
+Metrics::Registration Metrics::AddHistogram(const std::string& name,
+                                            const std::string& help,
+                                            const Histogram* histogram,
+                                            const std::string& labels) {
+  return Add({0, name, help, "histogram", labels, nullptr, histogram});
+}
+
+Metrics::Registration Metrics::Add(Metric metric) {
+  Mutex::Lock lock(mutex_);
+  metric.id = next_id_++;
+  metrics_.push_back(std::move(metric));
+  return Registration(metrics_.back().id);
+}
+
+void Metrics::Remove(int id) {
+  Mutex::Lock lock(mutex_);
+  metrics_.erase(std::remove_if(metrics_.begin(), metrics_.end(),
+                                [id](const Metric& m) { return m.id == id; }),
+                 metrics_.end());
+}
+
+std::string Metrics::Render() const {
+  Mutex::Lock lock(mutex_);
+  // Samples of the same metric must be grouped under a single HELP/TYPE
+  // header.
+  std::vector<const Metric*> sorted;
+  for (const auto& metric : metrics_) sorted.push_back(&metric);
+  std::stable_sort(sorted.begin(), sorted.end(),
+                   [](const Metric* a, const Metric* b) {
+                     return a->name < b->name;
+                   });
+
+  std::string result;
+  const std::string* last_name = nullptr;
+  for (const Metric* metric : sorted) {
+    if (!last_name || *last_name != metric->name) {
+      result += "# HELP " + metric->name + " " + metric->help + "\n";
+      result += "# TYPE " + metric->name + " " + metric->type + "\n";
+      last_name = &metric->name;
+    }
+    if (metric->histogram) {
+      metric->histogram->Render(metric->name, metric->labels, &result);
+    } else {
+      result += WithLabels(metric->name, metric->labels) + " " +
+                FormatValue(metric->callback()) + "\n";
+    }
+  }
+  return result;
+}
+
+/////////////////////////////////////////////////////////////////////////
+// MetricsExporter
+/////////////////////////////////////////////////////////////////////////
+
+MetricsExporter::MetricsExporter(const std::string& filename, int interval_ms)
+    : filename_(filename), interval_ms_(interval_ms) {
+  thread_ = std::thread([this]() { Worker(); });
+}
+
+MetricsExporter::~MetricsExporter() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  cv_.notify_all();
+  thread_.join();
+}
+
+void MetricsExporter::PopulateOptions(OptionsParser* options) {
+  options->Add<StringOption>(kMetricsFileStr, "metrics-file") = "";
+  options->Add<IntOption>(kMetricsIntervalStr, 100, 3600000,
+                          "metrics-interval") = 10000;
+}
+
+std::unique_ptr<MetricsExporter> MetricsExporter::Create(
+    const OptionsDict& options) {
+  const auto filename = options.Get<std::string>(kMetricsFileStr);
+  if (filename.empty()) return nullptr;
+  return std::make_unique<MetricsExporter>(
+      filename, options.Get<int>(kMetricsIntervalStr));
+}
+
+void MetricsExporter::Worker() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    cv_.wait_for(lock, std::chrono::milliseconds(interval_ms_),
+                 [this]() { return stop_; });
+    WriteFile();
+    if (stop_) break;
+  }
+}
+
+void MetricsExporter::WriteFile() const {
+  const std::string tmp_filename = filename_ + ".tmp";
+  {
+    std::ofstream file(tmp_filename);
+    if (!file) {
+      std::cerr << "Cannot write metrics to " << tmp_filename << std::endl;
+      return;
+    }
+    file << Metrics::Get()->Render();
+  }
+  std::rename(tmp_filename.c_str(), filename_.c_str());
+}
+
+}  // namespace lczero
@@ -0,0 +1,142 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2018 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "utils/mutex.h"
+#include "utils/optionsdict.h"
+#include "utils/optionsparser.h"
+
+namespace lczero {
+
+// Process-wide registry of runtime metrics. Values are not stored in the
+// registry: counters and gauges are read through callbacks at export time, so
+// that components only have to expose stats they already keep.
+class Metrics {
+ public:
+  using Callback = std::function<double()>;
+
+  // Distribution of observed values with fixed bucket bounds. Thread-safe.
+  class Histogram {
+   public:
+    // @bounds are upper bounds of buckets, in increasing order. Implicit
+    // +Inf bucket is added after the last one.
+    explicit Histogram(std::vector<double> bounds);
+
+    void Add(double value);
+    // Returns approximate @quantile (0..1) of observed values, interpolated
+    // within a bucket. Returns 0 if there are no observations.
+    double GetQuantile(double quantile) const;
+    // Appends Prometheus exposition lines of the histogram to @out.
+    void Render(const std::string& name, const std::string& labels,
+                std::string* out) const;
+
+   private:
+    const std::vector<double> bounds_;
+    mutable Mutex mutex_;
+    // Non-cumulative counts, the last element is the +Inf bucket.
+    std::vector<uint64_t> counts_ GUARDED_BY(mutex_);
+    uint64_t total_count_ GUARDED_BY(mutex_) = 0;
+    double sum_ GUARDED_BY(mutex_) = 0.0;
+  };
+
+  // Keeps metric registered while alive. Callbacks are guaranteed not to be
+  // running (and not to be called afterwards) when the destructor returns.
+  class Registration {
+   public:
+    Registration() = default;
+    explicit Registration(int id) : id_(id) {}
+    Registration(Registration&& other) : id_(other.id_) { other.id_ = -1; }
+    Registration& operator=(Registration&& other);
+    ~Registration();
+
+   private:
+    int id_ = -1;
+  };
+
+  static Metrics* Get();
+
+  // Registers a monotonically increasing value. @labels is either empty or
+  // a Prometheus label list without braces, e.g. "backend=\"blas\"".
+  Registration AddCounter(const std::string& name, const std::string& help,
+                          Callback callback, const std::string& labels = "");
+  // Registers a value which can go up and down.
+  Registration AddGauge(const std::string& name, const std::string& help,
+                        Callback callback, const std::string& labels = "");
+  // Registers a histogram. It must outlive the registration.
+  Registration AddHistogram(const std::string& name, const std::string& help,
+                            const Histogram* histogram,
+                            const std::string& labels = "");
+
+  // Returns all metrics in Prometheus text exposition format.
+  std::string Render() const;
+
+ private:
+  struct Metric {
+    int id;
+    std::string name;
+    std::string help;
+    std::string type;
+    std::string labels;
+    Callback callback;
+    const Histogram* histogram;
+  };
+
+  Registration Add(Metric metric);
+  void Remove(int id);
+
+  mutable Mutex mutex_;
+  int next_id_ GUARDED_BY(mutex_) = 0;
+  std::vector<Metric> metrics_ GUARDED_BY(mutex_);
+};
+
+// Periodically writes all registered metrics into a file, in a format which
+// can be picked up by node_exporter's textfile collector. The file is
+// replaced atomically, so readers never see partially written output.
+class MetricsExporter {
+ public:
+  MetricsExporter(const std::string& filename, int interval_ms);
+  // Writes metrics for the last time and stops the thread.
+  ~MetricsExporter();
+
+  // Populates command line options that it uses.
+  static void PopulateOptions(OptionsParser* options);
+  // Returns exporter configured by @options, or nullptr if exporting is
+  // disabled.
+  static std::unique_ptr<MetricsExporter> Create(const OptionsDict& options);
+
+ private:
+  void Worker();
+  void WriteFile() const;
+
+  const std::string filename_;
+  const int interval_ms_;
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  bool stop_ = false;
+  std::thread thread_;
+};
+
+}  // namespace lczero
@@ -0,0 +1,94 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2018 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "utils/numa.h"
+
+#include <atomic>
+#include <iostream>
+
+#ifdef USE_LIBNUMA
+#include <numa.h>
+#endif
+
+namespace lczero {
+
+namespace {
+const char* kNumaPinningStr = "Pin threads to NUMA nodes";
+
+std::atomic<bool> gPinning{false};
+thread_local int tThreadNode = 0;
+
+void SetPinning(bool enabled) {
+  if (enabled && !gPinning && GetMaxNumaNodes() == 1) {
+#ifdef USE_LIBNUMA
+    std::cerr << "Not a NUMA machine, threads are not pinned." << std::endl;
+#else
+    std::cerr << "Built without libnuma, threads are not pinned." << std::endl;
+#endif
+  }
+  gPinning = enabled;
+}
+}  // namespace
+
+void PopulateNumaOptions(OptionsParser* options) {
+  options->Add<BoolOption>(kNumaPinningStr, "numa-pinning", '\0',
+                           &SetPinning) = false;
+}
+
+void ConfigureNuma(const OptionsDict& options) {
+  SetPinning(options.Get<bool>(kNumaPinningStr));
+}
+
+int GetMaxNumaNodes() {
+#ifdef USE_LIBNUMA
+  static const int nodes = numa_available() < 0 ? 1 : numa_max_node() + 1;
+  return nodes;
+#else
+  return 1;
+#endif
+}
+
+int GetNumaNodeCount() { return gPinning ? GetMaxNumaNodes() : 1; }
+
+void BindThreadToNumaNode(int thread_idx) {
+#ifdef USE_LIBNUMA
+  const int nodes = GetNumaNodeCount();
+  if (nodes == 1) return;
+  const int node = thread_idx % nodes;
+  // Nodes without CPUs can't run threads, keep such threads unpinned.
+  if (numa_run_on_node(node) != 0) return;
+  numa_set_preferred(node);
+  tThreadNode = node;
+#else
+  (void)thread_idx;
+#endif
+}
+
+int GetThreadNumaNode() { return tThreadNode; }
+
+void BindMemoryToNumaNode(void* memory, size_t size, int node) {
+#ifdef USE_LIBNUMA
+  if (GetNumaNodeCount() > 1) numa_tonode_memory(memory, size, node);
+#else
+  (void)memory;
+  (void)size;
+  (void)node;
+#endif
+}
+
+}  // namespace lczero
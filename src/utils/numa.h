@@ -0,0 +1,55 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2018 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include "utils/optionsdict.h"
+#include "utils/optionsparser.h"
+
+namespace lczero {
+
+// NUMA (non-uniform memory access) placement of threads and memory, so that
+// on multi-socket machines threads work with memory of their own socket. Uses
+// libnuma when lc0 is built with it (USE_LIBNUMA). Without it, or when the
+// machine is not NUMA, everything runs as on a single node.
+
+// Populates command line options for NUMA.
+void PopulateNumaOptions(OptionsParser* options);
+// Enables or disables thread pinning according to @options. Threads which
+// are already running are not affected.
+void ConfigureNuma(const OptionsDict& options);
+
+// Returns the number of NUMA nodes of the machine, regardless of whether
+// pinning is enabled. 1 without libnuma.
+int GetMaxNumaNodes();
+// Returns the number of NUMA nodes threads are spread over, 1 if pinning is
+// disabled or not supported.
+int GetNumaNodeCount();
+
+// Pins the calling thread to the CPUs and memory of NUMA node
+// @thread_idx % GetNumaNodeCount(). Does nothing if pinning is disabled.
+void BindThreadToNumaNode(int thread_idx);
+// Returns NUMA node the calling thread is pinned to, 0 if it's not pinned.
+int GetThreadNumaNode();
+
+// Places pages of @memory on NUMA @node. Has to be called before they are
+// touched. Does nothing if pinning is disabled.
+void BindMemoryToNumaNode(void* memory, size_t size, int node);
+
+}  // namespace lczero
@@ -17,33 +17,68 @@
 */
 
 #include "random.h"
+#include <atomic>
 #include <random>
+#include "utils/hashcat.h"
 
 namespace lczero {
 
-Random::Random() : gen_(std::random_device()()) {}
+namespace {
+std::atomic<std::uint64_t> gSeed{0};
+
+std::uint64_t GetRandomDeviceSeed() {
+  std::random_device rd;
+  return (static_cast<std::uint64_t>(rd()) << 32) ^ rd();
+}
+
+void SeedGenerator(std::mt19937* gen, std::uint64_t seed) {
+  std::seed_seq seq{static_cast<std::uint32_t>(seed),
+                    static_cast<std::uint32_t>(seed >> 32)};
+  gen->seed(seq);
+}
+
+}  // namespace
+
+Random::Random() { SeedGenerator(&gen_, GetRandomDeviceSeed()); }
 
 Random& Random::Get() {
-  static Random rand;
+  static thread_local Random rand;
   return rand;
 }
 
+void Random::SetSeed(std::uint64_t seed) {
+  gSeed = seed;
+  Get().Reseed({});
+}
+
+std::uint64_t Random::GetSeed() { return gSeed; }
+
+void Random::Reseed(std::initializer_list<std::uint64_t> stream) {
+  std::uint64_t seed = gSeed;
+  if (seed == 0) seed = GetRandomDeviceSeed();
+  SeedGenerator(&gen_, HashCat(seed, HashCat(stream)));
+}
+
+void Random::Seed(std::uint64_t seed) { SeedGenerator(&gen_, seed); }
+
 int Random::GetInt(int min, int max) {
-  Mutex::Lock lock(mutex_);
   std::uniform_int_distribution<> dist(min, max);
   return dist(gen_);
 }
 
 bool Random::GetBool() { return GetInt(0, 1) != 0; }
 
+std::uint64_t Random::GetUint64() {
+  std::uniform_int_distribution<std::uint64_t> dist;
+  return dist(gen_);
+}
+
 double Random::GetDouble(double maxval) {
-  Mutex::Lock lock(mutex_);
   std::uniform_real_distribution<> dist(0.0, maxval);
   return dist(gen_);
 }
 
 float Random::GetFloat(float maxval) {
-  Mutex::Lock lock(mutex_);
   std::uniform_real_distribution<> dist(0.0, maxval);
   return dist(gen_);
 }
@@ -57,9 +92,8 @@ std::string Random::GetString(int length) {
 }
 
 double Random::GetGamma(double alpha, double beta) {
-  Mutex::Lock lock(mutex_);
   std::gamma_distribution<double> dist(alpha, beta);
   return dist(gen_);
 }
 
-}  // namespace lczero
\ No newline at end of file
+}  // namespace lczero
@@ -18,15 +18,36 @@
 
 #pragma once
 
+#include <cstdint>
+#include <initializer_list>
 #include <random>
 #include <string>
-#include "utils/mutex.h"
 
 namespace lczero {
 
+// Every thread has its own generator, so no locking is needed. Generators are
+// seeded from std::random_device. To make runs reproducible, the global seed
+// is set, and threads whose numbers matter reseed their generators from it
+// with Reseed().
 class Random {
  public:
+  // Returns generator of the current thread.
   static Random& Get();
+  // Sets the global seed, and reseeds generator of the calling thread from it.
+  // 0 means that the seed is taken from std::random_device.
+  static void SetSeed(std::uint64_t seed);
+  // Returns the global seed.
+  static std::uint64_t GetSeed();
+  // Reseeds generator of the current thread from the global seed and
+  // @stream (e.g. game number, or search and worker index), so that the
+  // sequence of numbers doesn't depend on which thread happened to run it.
+  void Reseed(std::initializer_list<std::uint64_t> stream);
+  // Returns 64 random bits, e.g. to derive streams from.
+  std::uint64_t GetUint64();
+  // Seeds generator of the current thread with exactly @seed, regardless of
+  // the global seed.
+  void Seed(std::uint64_t seed);
+
   double GetDouble(double max_val);
   float GetFloat(float max_val);
   double GetGamma(double alpha, double beta);
@@ -38,8 +59,7 @@ class Random {
  private:
   Random();
 
-  Mutex mutex_;
-  std::mt19937 gen_ GUARDED_BY(mutex_);
+  std::mt19937 gen_;
 };
 
 }  // namespace lczero
\ No newline at end of file
@@ -0,0 +1,77 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2018 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "utils/random.h"
+#include <gtest/gtest.h>
+#include <thread>
+#include <vector>
+
+namespace lczero {
+
+namespace {
+std::vector<std::uint64_t> Sequence(
+    std::initializer_list<std::uint64_t> stream) {
+  Random::Get().Reseed(stream);
+  std::vector<std::uint64_t> result;
+  for (int i = 0; i < 8; ++i) result.push_back(Random::Get().GetUint64());
+  return result;
+}
+}  // namespace
+
+TEST(Random, ReseedIsReproducible) {
+  Random::SetSeed(42);
+  const auto first = Sequence({1, 2});
+  EXPECT_EQ(Sequence({1, 2}), first);
+  EXPECT_NE(Sequence({2, 1}), first);
+  EXPECT_NE(Sequence({1}), first);
+  Random::SetSeed(43);
+  EXPECT_NE(Sequence({1, 2}), first);
+  Random::SetSeed(0);
+}
+
+TEST(Random, ReseedDoesNotDependOnThread) {
+  Random::SetSeed(42);
+  const auto expected = Sequence({7, 3});
+  std::vector<std::uint64_t> other;
+  std::thread thread([&other]() { other = Sequence({7, 3}); });
+  thread.join();
+  EXPECT_EQ(other, expected);
+  Random::SetSeed(0);
+}
+
+TEST(Random, SetSeedReseedsCallingThread) {
+  Random::SetSeed(42);
+  const auto first = Random::Get().GetUint64();
+  Random::Get().GetUint64();
+  Random::SetSeed(42);
+  EXPECT_EQ(Random::Get().GetUint64(), first);
+  EXPECT_EQ(Random::GetSeed(), 42u);
+  Random::SetSeed(0);
+}
+
+TEST(Random, UnseededStreamsDiffer) {
+  Random::SetSeed(0);
+  EXPECT_NE(Sequence({1, 2}), Sequence({1, 2}));
+}
+
+}  // namespace lczero
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}